@@ -0,0 +1,268 @@
+// future.h
+//	Data structures for futures: the result of a computation that
+//	may not have finished yet.
+//
+//	A Future is completed, once, by Set -- by the thread that was
+//	forked to compute it, with ForkFuture, or by anyone else.  Then
+//	its value can be had with Get, which waits for it, or TryGet,
+//	which doesn't.  Or instead of waiting, a thread can register a
+//	continuation with Then, to be called with the value as soon as
+//	there is one; the thread that completes the future calls it.
+//	So no thread has to sit blocked in Join for every outstanding
+//	computation.
+//
+//	A Future is deleted by whoever created it, once it is complete
+//	and every Get has returned; or it can be Detached, to be deleted
+//	as soon as it completes and its continuations have run.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include "copyright.h"
+#include "system.h"
+#include "synch.h"
+
+template <class T>
+class Future {
+public:
+    Future(char* debugName);	// initialize to "not complete"
+    ~Future();			// de-allocate; must be complete
+    char* getName() {
+        return name;   // debugging assist
+    }
+
+    void Set(T result);		// complete the future, and call its
+				// continuations
+    T Get();			// wait until complete, return the value
+    bool TryGet(T *result);	// if complete, store the value in
+				// *result and return TRUE
+    void Then(void (*callback)(T result, int arg), int arg);
+				// call (*callback)(value, arg) when complete
+    void Detach();		// delete once complete; the caller may
+				// not use the future afterwards
+    bool IsComplete() {
+        return complete;
+    }
+
+private:
+    class Continuation {
+    public:
+        void (*callback)(T result, int arg);
+        int arg;
+        Continuation *next;
+    };
+
+    char* name;			// useful for debugging
+    T value;			// valid once "setting" is TRUE
+    bool setting;		// has Set been called?
+    bool complete;		// ... and have the continuations run?
+    bool detached;		// delete when complete?
+    Continuation *first, *last;	// continuations not yet called
+    WaitQueue *waiters;		// threads waiting in Get
+};
+
+//----------------------------------------------------------------------
+// Future::Future
+// 	Initialize a future, with no value yet.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+template <class T>
+Future<T>::Future(char* debugName)
+{
+    name = debugName;
+    setting = complete = detached = FALSE;
+    first = last = NULL;
+    waiters = new WaitQueue(debugName);
+}
+
+//----------------------------------------------------------------------
+// Future::~Future
+// 	De-allocate a future.  It must be complete, or else the thread
+//	completing it would touch it afterwards.
+//----------------------------------------------------------------------
+
+template <class T>
+Future<T>::~Future()
+{
+    ASSERT(complete);
+    delete waiters;
+}
+
+//----------------------------------------------------------------------
+// Future::Set
+// 	Complete the future with "result": call each continuation in
+//	turn, including any registered meanwhile, then wake every thread
+//	waiting in Get.
+//
+//	The future is not marked complete until the continuations have
+//	run, so that no one deletes it under our feet.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Future<T>::Set(T result)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Continuation *next;
+    bool deleting;
+
+    ASSERT(!setting);		// a future is only completed once
+    value = result;
+    setting = TRUE;
+    while ((next = first) != NULL) {
+        first = next->next;
+        if (first == NULL)
+            last = NULL;
+        (void) interrupt->SetLevel(oldLevel);
+        (*next->callback)(value, next->arg);
+        delete next;
+        (void) interrupt->SetLevel(IntOff);
+    }
+    complete = TRUE;
+    deleting = detached;	// once interrupts are on, the future may
+				// be deleted under us
+    (void) waiters->WakeAll();
+    (void) interrupt->SetLevel(oldLevel);
+
+    if (deleting)
+        delete this;
+}
+
+//----------------------------------------------------------------------
+// Future::Get
+// 	Wait until the future is complete, and return its value.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+Future<T>::Get()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(!detached);
+    while (!complete)
+        waiters->Sleep();
+    (void) interrupt->SetLevel(oldLevel);
+    return value;
+}
+
+//----------------------------------------------------------------------
+// Future::TryGet
+// 	If the future is complete, store its value in "*result" and
+//	return TRUE; otherwise return FALSE at once.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+Future<T>::TryGet(T *result)
+{
+    ASSERT(!detached);
+    if (!complete)
+        return FALSE;
+    *result = value;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Future::Then
+// 	Arrange for (*callback)(value, arg) to be called when the future
+//	is complete -- by the thread that completes it, or right now, by
+//	us, if it already has been.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Future<T>::Then(void (*callback)(T result, int arg), int arg)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Continuation *c;
+
+    ASSERT(!detached);
+    if (setting && first == NULL) {	// Set has run the rest
+        (void) interrupt->SetLevel(oldLevel);
+        (*callback)(value, arg);
+        return;
+    }
+    c = new Continuation;
+    c->callback = callback;
+    c->arg = arg;
+    c->next = NULL;
+    if (last == NULL)
+        first = c;
+    else
+        last->next = c;
+    last = c;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Future::Detach
+// 	Give the future up: it deletes itself once it is complete, or
+//	right now if it already is.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Future<T>::Detach()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(!detached);
+    if (complete) {
+        (void) interrupt->SetLevel(oldLevel);
+        delete this;
+        return;
+    }
+    detached = TRUE;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// ForkFuture
+// 	Fork "thread" to compute (*func)(arg), and return a future for
+//	the result, completed when the procedure returns.  The thread
+//	should not be joinable: no one needs to Join it, and it is
+//	destroyed as soon as it finishes.
+//----------------------------------------------------------------------
+
+template <class T>
+class ForkedCall {
+public:
+    T (*func)(int arg);
+    int arg;
+    Future<T> *future;
+};
+
+template <class T>
+void
+ForkFutureRoot(int call)
+{
+    ForkedCall<T> *forked = (ForkedCall<T> *) call;
+    Future<T> *future = forked->future;
+    T result = (*forked->func)(forked->arg);
+
+    delete forked;
+    future->Set(result);
+}
+
+template <class T>
+Future<T> *
+ForkFuture(Thread *thread, T (*func)(int arg), int arg)
+{
+    ForkedCall<T> *forked = new ForkedCall<T>;
+    Future<T> *future = new Future<T>(thread->getName());
+
+    forked->func = func;
+    forked->arg = arg;
+    forked->future = future;
+    thread->Fork(ForkFutureRoot<T>, (int) forked);
+    return future;
+}
+
+#endif // FUTURE_H
@@ -236,3 +236,281 @@ List::SortedRemove(int *keyPtr)
     return thing;
 }
 
+
+//----------------------------------------------------------------------
+// HeapElement::HeapElement
+// 	Initialize a heap element, not yet on any heap.  The owner of
+//	the element is expected to fill in "item".
+//----------------------------------------------------------------------
+
+HeapElement::HeapElement()
+{
+    item = NULL;
+    key = 0;
+    seq = 0;
+    index = -1;
+    heap = NULL;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::PriorityHeap
+//	Initialize a heap, empty to start with.  The array of slots
+//	grows as needed.
+//----------------------------------------------------------------------
+
+PriorityHeap::PriorityHeap()
+{
+    capacity = 8;
+    heap = new HeapElement *[capacity];
+    size = 0;
+    nextSeq = 0;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::~PriorityHeap
+//	De-allocate the heap.  Any elements still on it are detached;
+//	as with List, the items themselves are not de-allocated.
+//----------------------------------------------------------------------
+
+PriorityHeap::~PriorityHeap()
+{
+    for (int i = 0; i < size; i++) {
+        heap[i]->heap = NULL;
+        heap[i]->index = -1;
+    }
+    delete [] heap;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::Insert
+//      Put "element" on the heap, so that it comes out in increasing
+//	order by "sortKey", after any elements already on the heap
+//	with the same key.
+//
+//	"element" is the handle of the item to be queued; it must not
+//		already be on a heap.
+//	"sortKey" is the priority of the item.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::Insert(HeapElement *element, int sortKey)
+{
+    ASSERT(element->heap == NULL);
+
+    if (size == capacity) {		// out of slots, double the array
+        HeapElement **bigger = new HeapElement *[capacity * 2];
+        for (int i = 0; i < size; i++)
+            bigger[i] = heap[i];
+        delete [] heap;
+        heap = bigger;
+        capacity *= 2;
+    }
+    element->key = sortKey;
+    element->seq = nextSeq++;
+    element->heap = this;
+    Place(element, size++);
+    SiftUp(element->index);
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::RemoveMin
+//      Remove the item with the smallest key from the heap.
+//
+// Returns:
+//	Pointer to removed item, NULL if nothing on the heap.
+//----------------------------------------------------------------------
+
+void *
+PriorityHeap::RemoveMin()
+{
+    void *thing;
+
+    if (IsEmpty())
+        return NULL;
+
+    thing = heap[0]->item;
+    Remove(heap[0]);
+    return thing;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::RemoveLast
+//      Remove the item in the last slot of the heap.  Nothing has to
+//	move, so draining a heap this way takes O(n) in all -- for
+//	when every item is coming off and their order doesn't matter.
+//
+// Returns:
+//	Pointer to removed item, NULL if nothing on the heap.
+//----------------------------------------------------------------------
+
+void *
+PriorityHeap::RemoveLast()
+{
+    void *thing;
+
+    if (IsEmpty())
+        return NULL;
+
+    thing = heap[size - 1]->item;
+    Remove(heap[size - 1]);
+    return thing;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::Min
+//      Return the item that RemoveMin would take off the heap, but
+//	leave it on the heap.
+//
+//	"keyPtr" if not NULL, is set to the key of that item.
+//----------------------------------------------------------------------
+
+void *
+PriorityHeap::Min(int *keyPtr)
+{
+    if (IsEmpty())
+        return NULL;
+    if (keyPtr != NULL)
+        *keyPtr = heap[0]->key;
+    return heap[0]->item;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::Remove
+//      Take "element" off the heap, from wherever it is.  The last
+//	element is moved into the hole and then sifted into place.
+//
+//	"element" must currently be on this heap.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::Remove(HeapElement *element)
+{
+    int i = element->index;
+    HeapElement *moved;
+
+    ASSERT(element->heap == this);
+
+    element->heap = NULL;
+    element->index = -1;
+    moved = heap[--size];
+    if (moved != element) {
+        Place(moved, i);
+        SiftUp(i);
+        SiftDown(moved->index);
+    }
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::ChangeKey
+//      Give "element" a new key, and move it up or down the heap to
+//	match.  The element is treated as if it were re-inserted: among
+//	elements with the same new key, it goes last.
+//
+//	"element" must currently be on this heap.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::ChangeKey(HeapElement *element, int sortKey)
+{
+    ASSERT(element->heap == this);
+
+    element->key = sortKey;
+    element->seq = nextSeq++;
+    SiftUp(element->index);
+    SiftDown(element->index);
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::Mapcar
+//	Apply a function to each item on the heap, in heap (not sorted)
+//	order.
+//
+//	"func" is the procedure to apply to each item on the heap.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::Mapcar(VoidFunctionPtr func)
+{
+    for (int i = 0; i < size; i++)
+        (*func)((int)heap[i]->item);
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::IsEmpty
+//      Returns TRUE if the heap is empty (has no elements).
+//----------------------------------------------------------------------
+
+bool
+PriorityHeap::IsEmpty()
+{
+    return (size == 0);
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::Before
+//      Returns TRUE if "a" should come off the heap before "b":
+//	smaller key first, and for equal keys, first in first out.
+//	Sequence numbers are compared by difference so that wrap-around
+//	of "nextSeq" does not matter.
+//----------------------------------------------------------------------
+
+bool
+PriorityHeap::Before(HeapElement *a, HeapElement *b)
+{
+    if (a->key != b->key)
+        return (a->key < b->key);
+    return ((int)(a->seq - b->seq) < 0);
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::Place
+//      Store "element" in slot "i", keeping its back-pointer current.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::Place(HeapElement *element, int i)
+{
+    heap[i] = element;
+    element->index = i;
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::SiftUp
+//      Move the element in slot "i" toward the root until its parent
+//	comes out before it.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::SiftUp(int i)
+{
+    HeapElement *element = heap[i];
+
+    while (i > 0 && Before(element, heap[(i - 1) / 2])) {
+        Place(heap[(i - 1) / 2], i);
+        i = (i - 1) / 2;
+    }
+    Place(element, i);
+}
+
+//----------------------------------------------------------------------
+// PriorityHeap::SiftDown
+//      Move the element in slot "i" away from the root until both of
+//	its children come out after it.
+//----------------------------------------------------------------------
+
+void
+PriorityHeap::SiftDown(int i)
+{
+    HeapElement *element = heap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < size) {
+        if (child + 1 < size && Before(heap[child + 1], heap[child]))
+            child++;
+        if (!Before(heap[child], element))
+            break;
+        Place(heap[child], i);
+        i = child;
+    }
+    Place(element, i);
+}
@@ -63,4 +63,63 @@ private:
     ListElement *last;		// Last element of list
 };
 
+// The following class defines a "heap element" -- the handle an item
+// keeps for itself while it sits on a PriorityHeap.
+//
+// Unlike a ListElement, a HeapElement is not allocated by the heap;
+// it is embedded in the item (a Thread, for instance), so the item
+// can always find its own position ("index") and the heap it is
+// on ("heap").  That is what lets an item be re-keyed or pulled out
+// of the middle of a heap in O(log n).
+
+class PriorityHeap;
+
+class HeapElement {
+public:
+    HeapElement();		// initialize to "not on any heap"
+
+    void *item;			// the item this element keeps track of
+    int key;			// priority, smallest key comes out first
+    unsigned seq;		// insertion order, to break ties FIFO
+    int index;			// slot in the heap array, -1 if not queued
+    PriorityHeap *heap;		// heap we are on, NULL if none
+};
+
+// The following class defines a "priority heap" -- a binary min-heap
+// of HeapElements, ordered by "key" and then by insertion order.
+// Elements with equal keys come out in the order they went in, just
+// as they would from List::SortedInsert/List::Remove.
+//
+// An element may be on at most one heap at a time.
+
+class PriorityHeap {
+public:
+    PriorityHeap();		// initialize the heap
+    ~PriorityHeap();		// de-allocate the heap
+
+    void Insert(HeapElement *element, int sortKey); // Put element on heap
+    void *RemoveMin();		// Take smallest item off the heap
+    void *RemoveLast();		// Take any item off the heap, in O(1)
+    void *Min(int *keyPtr);	// Peek at smallest item, without removing
+    void Remove(HeapElement *element);	// Take element off the heap,
+					// wherever it is
+    void ChangeKey(HeapElement *element, int sortKey);
+				// Re-position element for its new key
+
+    void Mapcar(VoidFunctionPtr func);	// Apply "func" to every item
+    bool IsEmpty();		// is the heap empty?
+    int NumInHeap() { return size; }
+
+private:
+    HeapElement **heap;		// heap[0] is the smallest element
+    int size;			// number of elements on the heap
+    int capacity;		// number of slots allocated in "heap"
+    unsigned nextSeq;		// sequence number for the next Insert
+
+    bool Before(HeapElement *a, HeapElement *b);  // a comes out first?
+    void Place(HeapElement *element, int i);	// store element at slot i
+    void SiftUp(int i);		// restore heap order above slot i
+    void SiftDown(int i);	// restore heap order below slot i
+};
+
 #endif // LIST_H
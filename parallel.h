@@ -0,0 +1,313 @@
+// parallel.h
+//	Parallel algorithms, run as tasks on a TaskRuntime: ParallelFor,
+//	ParallelReduce, ParallelScan and ParallelSort.
+//
+//	Each splits its range in halves, spawning one half and running
+//	the other, until a piece is no bigger than "grain"; that piece
+//	is done serially.  A small grain gives the most parallelism, a
+//	big one the least overhead; a grain of 0 or less chooses one
+//	automatically, giving each worker about 8 pieces.
+//
+//	They may be called from outside the runtime, or from a task
+//	running on it, in which case they run as part of that task.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "copyright.h"
+#include "thread.h"
+
+// Choose a grain for "n" items, if the caller didn't.
+
+inline int
+ParallelGrain(TaskRuntime *runtime, int n, int grain)
+{
+    if (grain > 0)
+        return grain;
+    grain = n / (8 * runtime->NumWorkers());
+    return grain > 0 ? grain : 1;
+}
+
+// Run a task to completion: directly, if we are already in one, or
+// else by handing it to the runtime.
+
+inline void
+ParallelRun(TaskRuntime *runtime, VoidFunctionPtr func, int arg)
+{
+    if (runtime->InTask())
+        (*func)(arg);
+    else
+        runtime->Run(func, arg);
+}
+
+//----------------------------------------------------------------------
+// ParallelFor
+// 	Call body->Run(i, j) for pieces [i, j) covering [first, last),
+//	in parallel.
+//----------------------------------------------------------------------
+
+template <class Body>
+class ForRange {
+public:
+    TaskRuntime *runtime;
+    int first, last;		// the range to cover, [first, last)
+    int grain;
+    Body *body;
+};
+
+template <class Body>
+void
+ParallelForTask(int arg)
+{
+    ForRange<Body> *range = (ForRange<Body> *) arg;
+    ForRange<Body> left = *range, right = *range;
+
+    if (range->last - range->first <= range->grain) {
+        range->body->Run(range->first, range->last);
+        return;
+    }
+    left.last = right.first = range->first + (range->last - range->first) / 2;
+    range->runtime->Spawn(ParallelForTask<Body>, (int) &left);
+    ParallelForTask<Body>((int) &right);
+    range->runtime->Sync();
+}
+
+template <class Body>
+void
+ParallelFor(TaskRuntime *runtime, int first, int last, int grain, Body *body)
+{
+    ForRange<Body> *range = new ForRange<Body>;
+
+    range->runtime = runtime;
+    range->first = first;
+    range->last = last;
+    range->grain = ParallelGrain(runtime, last - first, grain);
+    range->body = body;
+    ParallelRun(runtime, ParallelForTask<Body>, (int) range);
+    delete range;
+}
+
+//----------------------------------------------------------------------
+// ParallelReduce
+// 	Return the combination of every item in [first, last).  Each
+//	piece [i, j) is folded serially by body->Reduce(i, j, init),
+//	starting from "identity"; the pieces' results are combined by
+//	body->Combine(left, right), which must be associative.
+//----------------------------------------------------------------------
+
+template <class T, class Body>
+class ReduceRange {
+public:
+    TaskRuntime *runtime;
+    int first, last;		// the range to reduce, [first, last)
+    int grain;
+    Body *body;
+    T result;			// starts as the identity
+};
+
+template <class T, class Body>
+void
+ParallelReduceTask(int arg)
+{
+    ReduceRange<T, Body> *range = (ReduceRange<T, Body> *) arg;
+    ReduceRange<T, Body> left = *range, right = *range;
+
+    if (range->last - range->first <= range->grain) {
+        range->result = range->body->Reduce(range->first, range->last,
+                                            range->result);
+        return;
+    }
+    left.last = right.first = range->first + (range->last - range->first) / 2;
+    range->runtime->Spawn(ParallelReduceTask<T, Body>, (int) &left);
+    ParallelReduceTask<T, Body>((int) &right);
+    range->runtime->Sync();
+    range->result = range->body->Combine(left.result, right.result);
+}
+
+template <class T, class Body>
+T
+ParallelReduce(TaskRuntime *runtime, int first, int last, int grain,
+               T identity, Body *body)
+{
+    ReduceRange<T, Body> *range = new ReduceRange<T, Body>;
+    T result;
+
+    range->runtime = runtime;
+    range->first = first;
+    range->last = last;
+    range->grain = ParallelGrain(runtime, last - first, grain);
+    range->body = body;
+    range->result = identity;
+    ParallelRun(runtime, ParallelReduceTask<T, Body>, (int) range);
+    result = range->result;
+    delete range;
+    return result;
+}
+
+//----------------------------------------------------------------------
+// ParallelScan
+// 	Replace each of items[0..n-1] with the sum (by "+") of itself and
+//	every item before it.  This takes two passes over the pieces:
+//	the first sums each one in place, then the pieces' totals are
+//	summed serially, and the second adds those to every piece but
+//	the first.
+//----------------------------------------------------------------------
+
+template <class T>
+class ScanPieces {
+public:
+    T *items;
+    int n;
+    int grain;			// items per piece
+    T *totals;			// totals[p]: sum up to the end of piece p
+    bool offset;		// the second pass?
+
+    void Run(int first, int last) {	// pieces [first, last)
+        for (int p = first; p < last; p++) {
+            int lo = p * grain;
+            int hi = (lo + grain < n) ? lo + grain : n;
+
+            if (!offset) {
+                for (int i = lo + 1; i < hi; i++)
+                    items[i] = items[i - 1] + items[i];
+                totals[p] = items[hi - 1];
+            } else if (p > 0) {
+                for (int i = lo; i < hi; i++)
+                    items[i] = totals[p - 1] + items[i];
+            }
+        }
+    }
+};
+
+template <class T>
+void
+ParallelScan(TaskRuntime *runtime, T *items, int n, int grain)
+{
+    ScanPieces<T> *pieces = new ScanPieces<T>;
+    int numPieces;
+
+    if (n <= 0) {
+        delete pieces;
+        return;
+    }
+    pieces->items = items;
+    pieces->n = n;
+    pieces->grain = ParallelGrain(runtime, n, grain);
+    numPieces = (n + pieces->grain - 1) / pieces->grain;
+    pieces->totals = new T[numPieces];
+    pieces->offset = FALSE;
+    ParallelFor(runtime, 0, numPieces, 1, pieces);
+    for (int p = 1; p < numPieces; p++)
+        pieces->totals[p] = pieces->totals[p - 1] + pieces->totals[p];
+    pieces->offset = TRUE;
+    ParallelFor(runtime, 0, numPieces, 1, pieces);
+    delete [] pieces->totals;
+    delete pieces;
+}
+
+//----------------------------------------------------------------------
+// ParallelSort
+// 	Sort items[0..n-1] into increasing order (by "<"), by merge sort:
+//	the halves are sorted in parallel, then merged.  The sort is
+//	stable.  Pieces of "grain" items or fewer are sorted serially.
+//----------------------------------------------------------------------
+
+// Merge sorted a[0..na-1] and b[0..nb-1] into out.
+
+template <class T>
+void
+SortMerge(T *a, int na, T *b, int nb, T *out)
+{
+    int i = 0, j = 0, k = 0;
+
+    while (i < na && j < nb) {
+        if (b[j] < a[i])
+            out[k++] = b[j++];
+        else
+            out[k++] = a[i++];
+    }
+    while (i < na)
+        out[k++] = a[i++];
+    while (j < nb)
+        out[k++] = b[j++];
+}
+
+template <class T>
+void
+SortSerial(T *items, T *scratch, int n)
+{
+    int half = n / 2;
+
+    if (n <= 16) {			// insertion sort
+        for (int i = 1; i < n; i++) {
+            T item = items[i];
+            int j;
+
+            for (j = i; j > 0 && item < items[j - 1]; j--)
+                items[j] = items[j - 1];
+            items[j] = item;
+        }
+        return;
+    }
+    SortSerial(items, scratch, half);
+    SortSerial(items + half, scratch + half, n - half);
+    SortMerge(items, half, items + half, n - half, scratch);
+    for (int i = 0; i < n; i++)
+        items[i] = scratch[i];
+}
+
+template <class T>
+class SortRange {
+public:
+    TaskRuntime *runtime;
+    T *items;			// the items to sort
+    T *scratch;			// as many items' worth of space
+    int n;
+    int grain;
+};
+
+template <class T>
+void
+ParallelSortTask(int arg)
+{
+    SortRange<T> *range = (SortRange<T> *) arg;
+    SortRange<T> left = *range, right = *range;
+    int half = range->n / 2;
+
+    if (range->n <= range->grain) {
+        SortSerial(range->items, range->scratch, range->n);
+        return;
+    }
+    left.n = half;
+    right.items += half;
+    right.scratch += half;
+    right.n -= half;
+    range->runtime->Spawn(ParallelSortTask<T>, (int) &left);
+    ParallelSortTask<T>((int) &right);
+    range->runtime->Sync();
+    SortMerge(left.items, left.n, right.items, right.n, range->scratch);
+    for (int i = 0; i < range->n; i++)
+        range->items[i] = range->scratch[i];
+}
+
+template <class T>
+void
+ParallelSort(TaskRuntime *runtime, T *items, int n, int grain)
+{
+    SortRange<T> *range = new SortRange<T>;
+
+    range->runtime = runtime;
+    range->items = items;
+    range->scratch = new T[n > 0 ? n : 1];
+    range->n = n;
+    range->grain = ParallelGrain(runtime, n, grain);
+    ParallelRun(runtime, ParallelSortTask<T>, (int) range);
+    delete [] range->scratch;
+    delete range;
+}
+
+#endif // PARALLEL_H
@@ -14,6 +14,10 @@
 // 	Very simple implementation -- no priorities, straight FIFO.
 //	Might need to be improved in later assignments.
 //
+//	The ready list is a priority heap: highest priority first, FIFO
+//	among equal priorities.  Each thread carries its own handle into
+//	the heap, so Thread::setPriority can re-position a ready thread.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -29,17 +33,24 @@
 
 Scheduler::Scheduler()
 {
-    readyList = new List;
+    readyList = new PriorityHeap;
+    timeouts = new PriorityHeap;
+    alarmAt = -1;
+    firstDead = numDead = reaped = 0;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the list of ready threads, and any dead threads
+//	not reaped yet.  Their stacks go back to the stack pool, so this
+//	must be deleted first.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 {
+    Reap();
     delete readyList;
+    delete timeouts;
 }
 
 //----------------------------------------------------------------------
@@ -59,8 +70,9 @@ Scheduler::ReadyToRun (Thread *thread)
     //readyList->Append((void *)thread);
 
     //inserts based on the priority
-    readyList->SortedInsert((void *)thread, thread->getPriority()*(-1));
-    scheduler->Print();
+    readyList->Insert(thread->getQueueEntry(), thread->getPriority()*(-1));
+    if (DebugIsEnabled('t'))
+        Print();		// the whole list, so only when debugging
 }
 
 //----------------------------------------------------------------------
@@ -74,7 +86,19 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
-    return (Thread *)readyList->Remove();
+    return (Thread *)readyList->RemoveMin();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PeekNextToRun
+// 	Return the thread FindNextToRun would return, without removing
+//	it from the ready list.  If there are no ready threads, return NULL.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::PeekNextToRun ()
+{
+    return (Thread *)readyList->Min(NULL);
 }
 
 //----------------------------------------------------------------------
@@ -125,10 +149,7 @@ Scheduler::Run (Thread *nextThread)
     // we need to delete its carcass.  Note we cannot delete the thread
     // before now (for example, in Thread::Finish()), because up to this
     // point, we were still running on the old thread's stack!
-    if (threadToBeDestroyed != NULL) {
-        delete threadToBeDestroyed;
-        threadToBeDestroyed = NULL;
-    }
+    CheckToBeDestroyed();
 
 #ifdef USER_PROGRAM
     if (currentThread->space != NULL) {		// if there is an address space
@@ -138,10 +159,72 @@ Scheduler::Run (Thread *nextThread)
 #endif
 }
 
+//----------------------------------------------------------------------
+// Scheduler::CheckToBeDestroyed
+// 	If the thread we just switched from was finishing, dispose of it.
+//	If it is joinable, just free its stack, and leave the rest for
+//	Join to delete.  Otherwise put it on the dead list, rather than
+//	delete it now, on the way into the next thread: the dead are
+//	deleted in a batch, when a new thread needs a stack or when there
+//	is nothing else to do.  If the list is full, only the oldest is
+//	deleted here, to make room, so that no switch pays for a batch.
+//
+//	Called on the new thread's stack, by Run when a thread is switched
+//	back to, and by ThreadBegin when a thread first starts running.
+//----------------------------------------------------------------------
+
+void
+Scheduler::CheckToBeDestroyed()
+{
+    if (threadToBeDestroyed != NULL) {
+        if (threadToBeDestroyed->getIsJoinable()) {
+            threadToBeDestroyed->BecomeZombie();
+        } else {
+            if (numDead == DeadLimit)
+                DeleteOldestDead();
+            dead[(firstDead + numDead) % DeadLimit] = threadToBeDestroyed;
+            numDead++;
+        }
+        threadToBeDestroyed = NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Reap
+// 	Delete every thread on the dead list, giving their stacks back to
+//	the stack pool.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Reap()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    while (numDead > 0)
+        DeleteOldestDead();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::DeleteOldestDead
+// 	Delete the thread that has been on the dead list longest.  Called
+//	with interrupts off, and at least one thread on the list.
+//----------------------------------------------------------------------
+
+void
+Scheduler::DeleteOldestDead()
+{
+    ASSERT(numDead > 0);
+    delete dead[firstDead];
+    firstDead = (firstDead + 1) % DeadLimit;
+    numDead--;
+    reaped++;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
-//	the ready list.  For debugging.
+//	the ready list (in heap order, not sorted).  For debugging.
 //----------------------------------------------------------------------
 void
 Scheduler::Print()
@@ -149,3 +232,123 @@ Scheduler::Print()
     printf("Ready list contents:\n");
     readyList->Mapcar((VoidFunctionPtr) ThreadPrint);
 }
+
+//----------------------------------------------------------------------
+// AlarmHandler
+// 	Interrupt handler for a timed wait deadline.  Lets the scheduler
+//	wake up any threads whose time is up.
+//
+//	"dummy" is because every interrupt handler takes one argument,
+//		whether it needs it or not.
+//----------------------------------------------------------------------
+
+static void
+AlarmHandler(int dummy)
+{
+    scheduler->ExpireTimeouts();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SetTimeout
+// 	Arrange for a thread that is about to block on a wait queue to
+//	be taken off that queue, and made ready to run, in "ticks" ticks
+//	-- unless it is woken up first, and CancelTimeout is called.
+//
+//	Timed waits are kept in a heap, earliest deadline first, with
+//	only the earliest one backed by a pending interrupt, so that any
+//	number of threads can be in a timed wait at once.
+//
+//	"thread" is the thread about to wait.
+//	"ticks" is how long it may wait, > 0.
+//----------------------------------------------------------------------
+
+void
+Scheduler::SetTimeout (Thread *thread, int ticks)
+{
+    ASSERT(ticks > 0);
+
+    thread->setTimedOut(FALSE);
+    timeouts->Insert(thread->getTimeoutEntry(), stats->totalTicks + ticks);
+    ScheduleAlarm();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::CancelTimeout
+// 	Forget a thread's deadline, because it has been woken up (or is
+//	about to be).  Does nothing if the thread has no deadline.
+//
+//	We don't bother cancelling the alarm interrupt; if it was for
+//	this deadline, it will find nothing to do.
+//----------------------------------------------------------------------
+
+void
+Scheduler::CancelTimeout (Thread *thread)
+{
+    HeapElement *entry = thread->getTimeoutEntry();
+
+    if (entry->heap != NULL)
+        timeouts->Remove(entry);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ExpireTimeouts
+// 	Called when an alarm interrupt goes off.  Each thread whose
+//	deadline has passed is still blocked on a wait queue (being
+//	woken cancels the deadline), so take it off that queue, note
+//	that it timed out, and make it ready to run.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ExpireTimeouts ()
+{
+    Thread *thread;
+    HeapElement *entry;
+    int deadline;
+
+    if (alarmAt <= stats->totalTicks)
+        alarmAt = -1;			// that alarm has gone off
+
+    while ((thread = (Thread *)timeouts->Min(&deadline)) != NULL
+            && deadline <= stats->totalTicks) {
+        timeouts->RemoveMin();
+        entry = thread->getQueueEntry();
+        ASSERT(thread->getStatus() == BLOCKED && entry->heap != NULL);
+
+        DEBUG('t', "Timed wait of thread \"%s\" expired.\n",
+              thread->getName());
+        entry->heap->Remove(entry);
+        thread->setTimedOut(TRUE);
+        ReadyToRun(thread);
+    }
+    ScheduleAlarm();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ScheduleAlarm
+// 	Make sure there is an alarm interrupt due no later than the
+//	earliest deadline.  Only if that deadline is earlier than the
+//	pending alarm do we schedule another one; any later alarm still
+//	pending then just finds nothing to do.
+//
+//	The alarm is scheduled as a DiskInt, not a TimerInt: when the
+//	machine is idle, Interrupt::CheckIfDue takes a lone pending
+//	TimerInt to mean there is nothing left to do, and would halt
+//	Nachos with threads still in timed waits.  The threads package
+//	has no disk, so the two can't be confused.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ScheduleAlarm ()
+{
+    int deadline;
+
+    if (timeouts->Min(&deadline) == NULL)
+        return;
+    if (deadline <= stats->totalTicks)
+        deadline = stats->totalTicks + 1;	// overdue, go off next tick
+    if (alarmAt == -1 || deadline < alarmAt) {
+        interrupt->Schedule(AlarmHandler, 0, deadline - stats->totalTicks,
+                            DiskInt);
+        alarmAt = deadline;
+    }
+}
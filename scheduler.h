@@ -13,6 +13,9 @@
 #include "list.h"
 #include "thread.h"
 
+// Most dead threads kept waiting to be deleted.
+#define DeadLimit	32
+
 // The following class defines the scheduler/dispatcher abstraction --
 // the data structures and operations needed to keep track of which
 // thread is running, and which threads are ready but not running.
@@ -25,12 +28,43 @@ public:
     void ReadyToRun(Thread* thread);	// Thread can be dispatched.
     Thread* FindNextToRun();		// Dequeue first thread on the ready
     // list, if any, and return thread.
+    Thread* PeekNextToRun();		// Return the thread FindNextToRun
+    // would dequeue, but leave it queued.
     void Run(Thread* nextThread);	// Cause nextThread to start running
+    void CheckToBeDestroyed();		// Dispose of the thread that just
+    // finished, if any
+    void Reap();			// Delete the dead threads
+    int NumDead() {
+        return numDead;
+    }
+    int getReaped() {
+        return reaped;			// dead threads ever deleted
+    }
     void Print();			// Print contents of ready list
 
+    void SetTimeout(Thread* thread, int ticks);
+    // Wake thread from its wait queue
+    // in "ticks", unless cancelled
+    void CancelTimeout(Thread* thread);	// Thread was woken up in time
+    void ExpireTimeouts();		// Wake threads whose time is up;
+    // called by the alarm interrupt
+
 private:
-    List *readyList;  		// queue of threads that are ready to run,
-    // but not running
+    PriorityHeap *readyList;  	// queue of threads that are ready to run,
+    // but not running, highest priority first
+    PriorityHeap *timeouts;	// threads in a timed wait, earliest
+    // deadline first
+    int alarmAt;		// when the earliest pending alarm
+    // interrupt is due, -1 if none
+    void ScheduleAlarm();	// make sure an alarm is due by the
+    // earliest deadline
+
+    Thread *dead[DeadLimit];	// finished threads not yet deleted,
+				// a circular queue, oldest first
+    int firstDead;		// where the oldest is
+    int numDead;
+    int reaped;
+    void DeleteOldestDead();	// delete dead[firstDead]
 };
 
 #endif // SCHEDULER_H
@@ -27,6 +27,449 @@
 #include "system.h"
 #include "thread.h"
 #include "sysdep.h"
+
+//----------------------------------------------------------------------
+// WaitQueue::WaitQueue
+// 	Initialize a wait queue, with no one waiting.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+WaitQueue::WaitQueue(char* debugName)
+{
+    name = debugName;
+    queue = new PriorityHeap;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::~WaitQueue
+// 	De-allocate a wait queue.  No one may still be waiting on it!
+//----------------------------------------------------------------------
+
+WaitQueue::~WaitQueue()
+{
+    ASSERT(queue->IsEmpty());
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Sleep
+// 	Put the current thread on the queue, in priority order, and
+//	relinquish the CPU.  Returns once some other thread has woken
+//	us up with WakeOne, WakeN or WakeAll.
+//
+//	Like Thread::Sleep, assumes interrupts are already disabled.
+//----------------------------------------------------------------------
+
+void
+WaitQueue::Sleep()
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+
+    queue->Insert(currentThread->getQueueEntry(),
+                  currentThread->getPriority()*(-1));
+    currentThread->Sleep();
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Sleep
+// 	Like Sleep(), but if no one wakes us up within "timeout" ticks,
+//	the scheduler takes us back off the queue and makes us ready to
+//	run.
+//
+//	"timeout" is the most ticks to wait, > 0.
+//
+// Returns:
+//	TRUE if we were woken up, FALSE if we timed out.
+//----------------------------------------------------------------------
+
+bool
+WaitQueue::Sleep(int timeout)
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+
+    queue->Insert(currentThread->getQueueEntry(),
+                  currentThread->getPriority()*(-1));
+    scheduler->SetTimeout(currentThread, timeout);
+    currentThread->Sleep();
+    return !currentThread->getTimedOut();
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::WakeOne
+// 	Take the highest priority thread off the queue, and put it on
+//	the ready list.
+//
+// Returns:
+//	The thread woken up, NULL if no one was waiting.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::WakeOne()
+{
+    Thread *thread;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+
+    thread = (Thread *)queue->RemoveMin();
+    if (thread != NULL) {
+        scheduler->CancelTimeout(thread);
+        scheduler->ReadyToRun(thread);
+    }
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::WakeN
+// 	Wake up to "n" threads, highest priority first.
+//
+// Returns:
+//	The number of threads woken up.
+//----------------------------------------------------------------------
+
+int
+WaitQueue::WakeN(int n)
+{
+    int woken = 0;
+
+    while (woken < n && WakeOne() != NULL)
+        woken++;
+    return woken;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::WakeAll
+// 	Wake every thread on the queue, highest priority first.
+//
+// Returns:
+//	The number of threads woken up.
+//----------------------------------------------------------------------
+
+int
+WaitQueue::WakeAll()
+{
+    return WakeN(queue->NumInHeap());
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::ReleaseAll
+// 	Wake every thread on the queue.  Unlike WakeAll, take them off
+//	from the back of the heap, which needs no re-sorting, so this is
+//	O(n) -- the ready list orders them by priority again anyway.
+//
+// Returns:
+//	The number of threads woken up.
+//----------------------------------------------------------------------
+
+int
+WaitQueue::ReleaseAll()
+{
+    Thread *thread;
+    int woken = 0;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+
+    while ((thread = (Thread *)queue->RemoveLast()) != NULL) {
+        scheduler->CancelTimeout(thread);
+        scheduler->ReadyToRun(thread);
+        woken++;
+    }
+    return woken;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::Peek
+// 	Return the thread WakeOne would wake, leaving it on the queue.
+//	NULL if no one is waiting.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::Peek()
+{
+    return (Thread *)queue->Min(NULL);
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::MoveOne
+// 	Take the highest priority thread off this queue and put it on
+//	"dest", in priority order, without waking it up.
+//
+// Returns:
+//	The thread moved, NULL if no one was waiting.
+//----------------------------------------------------------------------
+
+Thread *
+WaitQueue::MoveOne(WaitQueue *dest)
+{
+    Thread *thread;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+
+    thread = (Thread *)queue->RemoveMin();
+    if (thread != NULL) {
+        scheduler->CancelTimeout(thread);	// its wait is over
+        dest->queue->Insert(thread->getQueueEntry(),
+                            thread->getPriority()*(-1));
+    }
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::MoveAll
+// 	Move every thread on this queue onto "dest", highest priority
+//	first, without waking any of them up.
+//
+// Returns:
+//	The number of threads moved.
+//----------------------------------------------------------------------
+
+int
+WaitQueue::MoveAll(WaitQueue *dest)
+{
+    int moved = 0;
+
+    while (MoveOne(dest) != NULL)
+        moved++;
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// WaitQueue::IsEmpty, WaitQueue::NumWaiting
+// 	Is anyone waiting, and how many.  As with the value of a
+//	semaphore, the answer may be stale unless interrupts are off.
+//----------------------------------------------------------------------
+
+bool
+WaitQueue::IsEmpty()
+{
+    return queue->IsEmpty();
+}
+
+int
+WaitQueue::NumWaiting()
+{
+    return queue->NumInHeap();
+}
+
+// Number of buckets in the lock profiler's table of records.
+#define ProfileBuckets	61
+
+//----------------------------------------------------------------------
+// LockStats::LockStats
+// 	Initialize an empty statistics record.
+//
+//	"debugName" is the name of the locks or conditions it counts.
+//		We keep our own copy: the record outlives the locks, and
+//		their names may be in memory that is freed with them.
+//	"condition" is TRUE if it counts Conditions, FALSE for Locks.
+//----------------------------------------------------------------------
+
+LockStats::LockStats(char* debugName, bool condition)
+{
+    name = new char[strlen(debugName) + 1];
+    strcpy(name, debugName);
+    isCondition = condition;
+    operations = contended = signals = 0;
+    totalWait = maxWait = 0;
+    for (int i = 0; i < HoldBuckets; i++)
+        holdHistogram[i] = 0;
+    numWaiters = 0;
+    next = NULL;
+    waiterSlots = 8;
+    waiters = new Thread *[waiterSlots];
+    for (int i = 0; i < waiterSlots; i++)
+        waiters[i] = NULL;
+}
+
+LockStats::~LockStats()
+{
+    delete [] name;
+    delete [] waiters;
+}
+
+//----------------------------------------------------------------------
+// LockStats::NoteWait
+// 	Record that "waiter" waited "ticks" ticks.  Waiters are counted
+//	once each, using a hash set of thread pointers that doubles when
+//	it is half full.
+//----------------------------------------------------------------------
+
+void
+LockStats::NoteWait(Thread *waiter, int ticks)
+{
+    unsigned long slot;
+
+    totalWait += ticks;
+    if (ticks > maxWait)
+        maxWait = ticks;
+
+    slot = ((unsigned long) waiter / sizeof(unsigned long)) % waiterSlots;
+    while (waiters[slot] != NULL && waiters[slot] != waiter)
+        slot = (slot + 1) % waiterSlots;
+    if (waiters[slot] != NULL)
+        return;				// seen this one before
+    waiters[slot] = waiter;
+    numWaiters++;
+
+    if (2 * numWaiters > waiterSlots) {	// re-hash into twice the slots
+        Thread **old = waiters;
+        int oldSlots = waiterSlots;
+
+        waiterSlots *= 2;
+        waiters = new Thread *[waiterSlots];
+        for (int i = 0; i < waiterSlots; i++)
+            waiters[i] = NULL;
+        for (int i = 0; i < oldSlots; i++) {
+            if (old[i] == NULL)
+                continue;
+            slot = ((unsigned long) old[i] / sizeof(unsigned long))
+                   % waiterSlots;
+            while (waiters[slot] != NULL)
+                slot = (slot + 1) % waiterSlots;
+            waiters[slot] = old[i];
+        }
+        delete [] old;
+    }
+}
+
+//----------------------------------------------------------------------
+// LockStats::NoteHold
+// 	Record that a lock was held for "ticks" ticks, in the histogram
+//	bucket for the number of bits in "ticks".
+//----------------------------------------------------------------------
+
+void
+LockStats::NoteHold(int ticks)
+{
+    int bucket = 0;
+
+    while (ticks > 0 && bucket < HoldBuckets - 1) {
+        ticks >>= 1;
+        bucket++;
+    }
+    holdHistogram[bucket]++;
+}
+
+//----------------------------------------------------------------------
+// LockStats::Print
+// 	Print this record as a line of the contention report; for a
+//	Lock, follow it with the non-empty buckets of the hold times.
+//----------------------------------------------------------------------
+
+void
+LockStats::Print()
+{
+    if (isCondition) {
+        printf("  %-20s %8d waits %8d signals %10d wait %8d max %5d waiters\n",
+               name, operations, signals, totalWait, maxWait, numWaiters);
+        return;
+    }
+
+    printf("  %-20s %8d acq %8d contended %10d wait %8d max %5d waiters\n",
+           name, operations, contended, totalWait, maxWait, numWaiters);
+    printf("  %-20s hold ticks:", "");
+    for (int i = 0; i < HoldBuckets; i++) {
+        if (holdHistogram[i] == 0)
+            continue;
+        if (i == 0)
+            printf(" 0:%d", holdHistogram[i]);
+        else if (i == HoldBuckets - 1)
+            printf(" %d+:%d", 1 << (i - 1), holdHistogram[i]);
+        else
+            printf(" %d-%d:%d", 1 << (i - 1), (1 << i) - 1, holdHistogram[i]);
+    }
+    printf("\n");
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::LockProfiler
+// 	Initialize the profiler, with no records yet.
+//----------------------------------------------------------------------
+
+LockProfiler::LockProfiler()
+{
+    buckets = new LockStats *[ProfileBuckets];
+    for (int i = 0; i < ProfileBuckets; i++)
+        buckets[i] = NULL;
+    numRecords = 0;
+}
+
+LockProfiler::~LockProfiler()
+{
+    LockStats *record, *next;
+
+    for (int i = 0; i < ProfileBuckets; i++) {
+        for (record = buckets[i]; record != NULL; record = next) {
+            next = record->next;
+            delete record;
+        }
+    }
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::Lookup
+// 	Find the record for Locks (or Conditions) named "debugName",
+//	creating it if this is the first one.
+//----------------------------------------------------------------------
+
+LockStats *
+LockProfiler::Lookup(char* debugName, bool condition)
+{
+    unsigned hash = condition ? 1 : 0;
+    LockStats *record;
+
+    for (char *c = debugName; *c != '\0'; c++)
+        hash = hash * 31 + *c;
+    hash %= ProfileBuckets;
+
+    for (record = buckets[hash]; record != NULL; record = record->next) {
+        if (record->isCondition == condition
+                && !strcmp(record->name, debugName))
+            return record;
+    }
+    record = new LockStats(debugName, condition);
+    record->next = buckets[hash];
+    buckets[hash] = record;
+    numRecords++;
+    return record;
+}
+
+//----------------------------------------------------------------------
+// LockProfiler::Print
+// 	Print the contention report: Locks, then Conditions, each sorted
+//	by total ticks spent waiting, most first.
+//----------------------------------------------------------------------
+
+void
+LockProfiler::Print()
+{
+    LockStats **sorted = new LockStats *[numRecords];
+    LockStats *record;
+    int n = 0, i, j;
+
+    for (i = 0; i < ProfileBuckets; i++)
+        for (record = buckets[i]; record != NULL; record = record->next)
+            sorted[n++] = record;
+
+    for (i = 1; i < n; i++) {		// insertion sort, by total wait
+        record = sorted[i];
+        for (j = i; j > 0 && sorted[j - 1]->totalWait < record->totalWait; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = record;
+    }
+
+    printf("Lock contention report (ticks):\n");
+    for (i = 0; i < n; i++)
+        if (!sorted[i]->isCondition)
+            sorted[i]->Print();
+    printf("Condition report (ticks):\n");
+    for (i = 0; i < n; i++)
+        if (sorted[i]->isCondition)
+            sorted[i]->Print();
+    delete [] sorted;
+}
+
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
 // 	Initialize a semaphore, so that it can be used for synchronization.
@@ -39,7 +482,9 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List;
+    queue = new WaitQueue(debugName);
+    handoff = FALSE;
+    wastedWakeups = 0;
 }
 
 //----------------------------------------------------------------------
@@ -61,6 +506,9 @@ Semaphore::~Semaphore()
 //
 //	Note that Thread::Sleep assumes that interrupts are disabled
 //	when it is called.
+//
+//	In handoff mode, a thread that had to wait is woken up by the V
+//	that gave it its unit, so it has nothing left to check.
 //----------------------------------------------------------------------
 
 void
@@ -68,14 +516,81 @@ Semaphore::P()
 {
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
 
-    while (value == 0) { 			// semaphore not available
-        queue->SortedInsert((void *)currentThread, currentThread->getPriority()*(-1));	// so go to sleep
-        currentThread->Sleep();
+    if (handoff) {
+        if (value > 0)
+            value--;				// semaphore available
+        else
+            queue->Sleep();			// V will hand us its unit
+    } else {
+        while (value == 0) { 			// semaphore not available
+            queue->Sleep();			// so go to sleep
+            if (value == 0)
+                wastedWakeups++;		// someone barged in
+        }
+        value--; 				// semaphore available,
+        // consume its value
+    }
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Semaphore::P
+// 	Like P(), but give up if the value is still 0 after "ticks" ticks.
+//
+//	"ticks" is the most ticks to wait; if <= 0, don't wait at all.
+//
+// Returns:
+//	TRUE if we decremented the value, FALSE if we timed out.
+//----------------------------------------------------------------------
+
+bool
+Semaphore::P(int ticks)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+    int deadline = stats->totalTicks + ticks;
+    bool acquired = TRUE;
+
+    if (value > 0) {
+        value--;
+    } else if (handoff) {
+        // V hands us a unit if it wakes us, so a wakeup is success
+        acquired = (ticks > 0) && queue->Sleep(ticks);
+    } else {
+        while (acquired && value == 0) {
+            acquired = (deadline > stats->totalTicks)
+                       && queue->Sleep(deadline - stats->totalTicks);
+            if (acquired && value == 0)
+                wastedWakeups++;		// someone barged in
+        }
+        if (acquired)
+            value--;
     }
-    value--; 					// semaphore available,
-    // consume its value
 
     (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return acquired;
+}
+
+//----------------------------------------------------------------------
+// Semaphore::TryP
+// 	Decrement the semaphore value if it is > 0, without waiting.
+//	Retry the compare-and-swap until it sticks or the value is 0;
+//	interrupts stay enabled and the wait queue is left alone.
+//
+// Returns:
+//	TRUE if we decremented the value, FALSE if it was 0.
+//----------------------------------------------------------------------
+
+bool
+Semaphore::TryP()
+{
+    int seen;
+
+    while ((seen = value) > 0) {
+        if (CompareAndSwap(&value, seen, seen - 1))
+            return TRUE;
+    }
+    return FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -84,18 +599,22 @@ Semaphore::P()
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that threads
 //	are disabled when it is called.
+//
+//	In handoff mode, if a thread is waiting, the unit goes to it
+//	directly and the value stays the same.
 //----------------------------------------------------------------------
 
 void
 Semaphore::V()
 {
-    Thread *thread;
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
 
-    thread = (Thread *)queue->Remove();
-    if (thread != NULL)	   // make thread ready, consuming the V immediately
-        scheduler->ReadyToRun(thread);
-    value++;
+    if (!handoff) {
+        queue->WakeOne();	// make a waiter ready, to compete for the unit
+        value++;
+    } else if (queue->WakeOne() == NULL) {
+        value++;		// no one waiting, keep the unit
+    }				// else the waiter we woke owns the unit
     (void) interrupt->SetLevel(oldLevel);
 }
 
@@ -104,128 +623,1481 @@ Semaphore::V()
 // the test case in the network assignment won't work!
 Lock::Lock(char* debugName) {
     name = debugName;
-    queue = new List;
-    held = false;
+    queue = new WaitQueue(debugName);
+    state = LOCK_FREE;
+    lockOwner = NULL;
+    handoff = FALSE;
+    wastedWakeups = 0;
+    profile = (lockProfiler != NULL) ? lockProfiler->Lookup(name, FALSE)
+                                     : NULL;
+    acquiredAt = 0;
 }
 Lock::~Lock() {
     // Make sure that the Lock is not held and the queue is empty
     // before allowing deletion of a lock.
-    ASSERT(!held);
+    ASSERT(state == LOCK_FREE);
     ASSERT(queue->IsEmpty());
     delete queue;
 }
 void Lock::Acquire() {
+    // Fast path: if the lock is free, take it with one compare-and-swap,
+    // without touching the interrupt level or the wait queue.
+    if (CompareAndSwap(&state, LOCK_FREE, LOCK_BUSY)) {
+        lockOwner = currentThread;
+        if (profile != NULL)
+            NoteAcquired(-1);
+        return;
+    }
+
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff); 
 
-    // While the lock is already held
-    while (held) {           
-        queue->SortedInsert((void *)currentThread, currentThread->getPriority()*(-1));   // Go to sleep
-        currentThread->Sleep();
-    }
+    (void) WaitToAcquire(-1);
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+}
+bool Lock::Acquire(int ticks) {
+    bool acquired;
+
+    if (CompareAndSwap(&state, LOCK_FREE, LOCK_BUSY)) {
+        lockOwner = currentThread;
+        if (profile != NULL)
+            NoteAcquired(-1);
+        return TRUE;
+    }
+    if (ticks <= 0)
+        return FALSE;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+    acquired = WaitToAcquire(ticks);
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+    return acquired;
+}
+bool Lock::TryAcquire() {
+    // Only the fast path: if the lock is not FREE, fail without
+    // disabling interrupts or queueing.
+    if (CompareAndSwap(&state, LOCK_FREE, LOCK_BUSY)) {
+        lockOwner = currentThread;
+        if (profile != NULL)
+            NoteAcquired(-1);
+        return TRUE;
+    }
+    return FALSE;
+}
+bool Lock::WaitToAcquire(int ticks) {
+    // Interrupts are off.  Condition::Wait comes here directly if it
+    // was moved onto our queue and woken without the lock handed over:
+    // the fast path would take a FREE lock without marking it as
+    // still having waiters.
+    int start = stats->totalTicks;
+    int deadline = start + ticks;
+    bool waited = FALSE;
+
+    // While the lock is already held, mark it as having waiters (so
+    // that Release takes the slow path and wakes us) and go to sleep.
+    while (state != LOCK_FREE) {
+        state = LOCK_WAITING;
+        waited = TRUE;
+        if (ticks < 0) {
+            queue->Sleep();
+        } else if (deadline <= stats->totalTicks
+                || !queue->Sleep(deadline - stats->totalTicks)) {
+            // Timed out.  The lock is still held by someone else; if
+            // we were the last waiter, it no longer has any.
+            if (state == LOCK_WAITING && queue->IsEmpty())
+                state = LOCK_BUSY;
+            if (profile != NULL) {
+                profile->contended++;
+                profile->NoteWait(currentThread, stats->totalTicks - start);
+            }
+            return FALSE;
+        }
+        if (lockOwner == currentThread) {
+            // in handoff mode, Release made us the owner
+            if (profile != NULL)
+                NoteAcquired(start);
+            return TRUE;
+        }
+        if (state != LOCK_FREE)
+            wastedWakeups++;		// someone barged in ahead of us
+    }
+
+    // Once Lock is free, make current thread the lock owner and
+    // change the lock's status to held.  Leave it marked as having
+    // waiters if anyone else is still queued.
+    lockOwner = currentThread;
+    state = queue->IsEmpty() ? LOCK_BUSY : LOCK_WAITING;
+    if (profile != NULL)
+        NoteAcquired(waited ? start : -1);
+    return TRUE;
+}
+void Lock::Release() {
+    // Make sure that the lock is held by the current thread.
+    ASSERT(isHeldByCurrentThread());
+    lockOwner = NULL;
+    if (profile != NULL)
+        profile->NoteHold(stats->totalTicks - acquiredAt);
+
+    // Fast path: no one is waiting, just free the lock.
+    if (CompareAndSwap(&state, LOCK_BUSY, LOCK_FREE))
+        return;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+
+    if (handoff) {
+        // Make the highest priority waiter the owner before it even
+        // runs, so no one can take the lock from it.
+        lockOwner = queue->WakeOne();
+        if (lockOwner == NULL)
+            state = LOCK_FREE;
+        else
+            state = queue->IsEmpty() ? LOCK_BUSY : LOCK_WAITING;
+    } else {
+        state = LOCK_FREE;
+        queue->WakeOne();      // make a waiter ready, if there is one
+    }
+
+    (void) interrupt->SetLevel(oldLevel); // re-enable interrupts
+}
+
+bool Lock::isHeldByCurrentThread(){
+    return (currentThread==lockOwner);
+
+}
+
+//----------------------------------------------------------------------
+// Lock::NoteAcquired
+// 	Tell the profiler that the current thread now owns the lock.
+//	"waitStart" is when it started waiting for it, or -1 if it got
+//	the lock without waiting.
+//----------------------------------------------------------------------
+
+void Lock::NoteAcquired(int waitStart) {
+    if (profile == NULL)
+        return;
+    profile->operations++;
+    if (waitStart >= 0) {
+        profile->contended++;
+        profile->NoteWait(currentThread, stats->totalTicks - waitStart);
+    }
+    acquiredAt = stats->totalTicks;
+}
+
+// Bounds on AdaptiveLock::spinLimit, and on the pause between two
+// looks at the lock, in iterations of the delay loop.
+#define MinSpinLimit	16
+#define MaxSpinLimit	4096
+#define MaxBackoff	64
+
+//----------------------------------------------------------------------
+// AdaptiveLock::AdaptiveLock
+// 	Initialize an adaptive lock, FREE, with a modest spin limit.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+AdaptiveLock::AdaptiveLock(char* debugName) : Lock(debugName)
+{
+    spinLimit = MinSpinLimit * 4;
+    spinWins = 0;
+    spinLosses = 0;
+    blockedAtOnce = 0;
+}
+
+//----------------------------------------------------------------------
+// SpinPause
+// 	Spend a little time, "iterations" turns of an empty loop, without
+//	touching the lock.  The loop counter is volatile so that the
+//	compiler keeps the loop.
+//----------------------------------------------------------------------
+
+static void
+SpinPause(int iterations)
+{
+    for (volatile int i = 0; i < iterations; i++)
+        ;
+}
+
+//----------------------------------------------------------------------
+// AdaptiveLock::Acquire
+// 	Wait until the lock is FREE, then set it to BUSY.
+//
+//	If the lock is busy and its owner is running on a CPU, poll the
+//	lock word, doubling the pause between polls, for up to spinLimit
+//	iterations.  Stop early if the owner stops running.  If that
+//	doesn't get us the lock, block in Lock::Acquire.
+//
+//	Afterwards, move spinLimit an eighth of the way toward twice the
+//	spin that won, or toward the minimum if spinning lost.
+//----------------------------------------------------------------------
+
+void
+AdaptiveLock::Acquire()
+{
+    Thread *owner;
+    int spins, backoff;
+    int start = stats->totalTicks;
+
+    if (CompareAndSwap(&state, LOCK_FREE, LOCK_BUSY)) {
+        lockOwner = currentThread;
+        if (profile != NULL)
+            NoteAcquired(-1);
+        return;
+    }
+
+    owner = lockOwner;
+    if (owner == NULL || owner == currentThread
+            || owner->getStatus() != RUNNING) {
+        blockedAtOnce++;
+        Lock::Acquire();
+        return;
+    }
+
+    backoff = 1;
+    for (spins = 0; spins < spinLimit; spins += backoff) {
+        SpinPause(backoff);
+        if (state == LOCK_FREE
+                && CompareAndSwap(&state, LOCK_FREE, LOCK_BUSY)) {
+            lockOwner = currentThread;
+            if (profile != NULL)
+                NoteAcquired(start);	// spinning counts as contention
+            spinWins++;
+            if (2 * spins > MaxSpinLimit)
+                spins = MaxSpinLimit / 2;
+            spinLimit += (2 * spins - spinLimit) / 8;
+            if (spinLimit < MinSpinLimit)
+                spinLimit = MinSpinLimit;
+            return;
+        }
+        owner = lockOwner;
+        if (owner != NULL && owner->getStatus() != RUNNING)
+            break;			// owner is off the CPU, stop spinning
+        if (backoff < MaxBackoff)
+            backoff *= 2;
+    }
+
+    spinLosses++;
+    spinLimit -= (spinLimit - MinSpinLimit) / 8;
+    Lock::Acquire();
+}
+
+//----------------------------------------------------------------------
+// AdaptiveLock::PrintStats
+// 	Print how often spinning won the lock, for tuning.
+//----------------------------------------------------------------------
+
+void
+AdaptiveLock::PrintStats()
+{
+    int spun = spinWins + spinLosses;
+
+    printf("AdaptiveLock %s: %d spins won, %d spins lost (%d%% success), "
+           "%d blocked without spinning, spin limit %d\n", name,
+           spinWins, spinLosses, (spun == 0) ? 0 : (100 * spinWins) / spun,
+           blockedAtOnce, spinLimit);
+}
+
+Condition::Condition(char* debugName) {
+    name = debugName;
+    waitingList = new WaitQueue(debugName);
+    profile = (lockProfiler != NULL) ? lockProfiler->Lookup(name, TRUE)
+                                     : NULL;
+}
+Condition::~Condition() {
+    // Check to see if the waiting list is empty before allowing
+    // deletion of the condition variable
+    ASSERT(waitingList->IsEmpty());
+    delete waitingList;
+}
+void Condition::Wait(Lock* conditionLock) {
+    int start = stats->totalTicks;
+
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+    // Release the lock
+    conditionLock->Release();
+    // Place the calling thread on the condition variable's waiting list
+    // and suspend its execution
+    waitingList->Sleep();
+
+    // Signal moved us onto the lock's queue, so we were woken by
+    // Release -- holding the lock already, if it was handed to us.
+    // Otherwise reacquire it, without the fast path.
+    if (!conditionLock->isHeldByCurrentThread())
+        (void) conditionLock->WaitToAcquire(-1);
+    else if (conditionLock->profile != NULL)
+        conditionLock->NoteAcquired(-1);
+    if (profile != NULL) {
+        profile->operations++;
+        profile->NoteWait(currentThread, stats->totalTicks - start);
+    }
+
+    // Re-enable interrupts
+    (void) interrupt->SetLevel(oldLevel);
+}
+bool Condition::Wait(Lock* conditionLock, int ticks) {
+    bool signalled = FALSE;
+    int start = stats->totalTicks;
+
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
+    conditionLock->Release();
+
+    // Wait for a signal, unless we aren't to wait at all.  If we time
+    // out, we are back on the ready list, not on the lock's queue.
+    if (ticks > 0)
+        signalled = waitingList->Sleep(ticks);
+
+    // Reacquire the lock, however long that takes.
+    if (!conditionLock->isHeldByCurrentThread())
+        (void) conditionLock->WaitToAcquire(-1);
+    else if (conditionLock->profile != NULL)
+        conditionLock->NoteAcquired(-1);
+    if (profile != NULL) {
+        profile->operations++;
+        profile->NoteWait(currentThread, stats->totalTicks - start);
+    }
+
+    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+    return signalled;
+}
+bool Condition::Signal(Lock* conditionLock) {
+    if (profile != NULL)
+        profile->signals++;
+    // Check to see if the list is empty
+    if(!waitingList->IsEmpty()){
+        ASSERT(conditionLock->isHeldByCurrentThread());
+
+        // Disable interrupts
+        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+        // Moves one thread off the condition variable's waiting list
+        // onto the lock's, where Release will wake it; mark the lock
+        // as having waiters so that Release does.
+        waitingList->MoveOne(conditionLock->queue);
+        conditionLock->state = LOCK_WAITING;
+
+        // Re-enable interrupts
+        (void) interrupt->SetLevel(oldLevel);
+        return TRUE;
+    }
+    else{
+        printf("There were no waiters\n");
+        return FALSE;
+    }
+}
+int Condition::Broadcast(Lock* conditionLock) {
+    int woken;
+
+    if (profile != NULL)
+        profile->signals++;
+    // Check to see if the list is empty
+    if(!waitingList->IsEmpty()){
+        ASSERT(conditionLock->isHeldByCurrentThread());
+
+        // Disable interrupts
+        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+        // Move all threads off the condition variable's waiting list
+        // onto the lock's, to be woken one at a time by Release.
+        woken = waitingList->MoveAll(conditionLock->queue);
+        conditionLock->state = LOCK_WAITING;
+
+        // Re-enable the interrupts
+        (void) interrupt->SetLevel(oldLevel);
+        return woken;
+    }
+    else{
+        // Used for testing purposed to notify that the 
+        // waiting list was empty.
+        printf("There were no waiters\n");
+        return 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, so that it can be used for
+//	synchronization.  The lock starts FREE.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"preferWriters" is TRUE if waiting writers should keep new
+//		readers out, so that writers cannot starve.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    Setup(debugName, FALSE);
+}
+
+RWLock::RWLock(char* debugName, bool preferWritersFlag)
+{
+    Setup(debugName, preferWritersFlag);
+}
+
+void
+RWLock::Setup(char* debugName, bool preferWritersFlag)
+{
+    name = debugName;
+    preferWriters = preferWritersFlag;
+    readers = 0;
+    writer = NULL;
+    writerWaking = FALSE;
+    readQueue = new WaitQueue(debugName);
+    writeQueue = new WaitQueue(debugName);
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	De-allocate a reader-writer lock, which must be free, with no
+//	one waiting for it.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(readers == 0 && writer == NULL);
+    ASSERT(readQueue->IsEmpty() && writeQueue->IsEmpty());
+    delete readQueue;
+    delete writeQueue;
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReaderMustWait
+// 	Return TRUE if the current thread may not join the readers yet:
+//	a writer holds the lock, or a writer is waiting and gets to go
+//	first -- any writer if we prefer writers, otherwise only one of
+//	higher priority than us.
+//
+//	Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+bool
+RWLock::ReaderMustWait()
+{
+    Thread *waitingWriter = writeQueue->Peek();
+
+    if (writer != NULL)
+        return TRUE;
+    if (waitingWriter == NULL)
+        return FALSE;
+    return preferWriters
+           || waitingWriter->getPriority() > currentThread->getPriority();
+}
+
+//----------------------------------------------------------------------
+// RWLock::WakeWaiters
+// 	The lock has just become free; let in the next waiters.  That is
+//	one writer, if we prefer writers or the first waiting writer has
+//	at least the priority of the first waiting reader; otherwise all
+//	the waiting readers.
+//
+//	The threads woken up re-check the lock when they run, so a thread
+//	that gets in first just sends them back to sleep.
+//
+//	Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+void
+RWLock::WakeWaiters()
+{
+    Thread *waitingWriter = writeQueue->Peek();
+    Thread *waitingReader = readQueue->Peek();
+
+    if (waitingWriter != NULL && (preferWriters || waitingReader == NULL
+            || waitingWriter->getPriority() >= waitingReader->getPriority())) {
+        writeQueue->WakeOne();
+        writerWaking = TRUE;
+    } else
+        readQueue->WakeAll();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReadAcquire
+// 	Wait until the lock can be shared with us, then join the readers.
+//----------------------------------------------------------------------
+
+void
+RWLock::ReadAcquire()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    ASSERT(writer != currentThread);
+    while (ReaderMustWait()) {
+        // If we are only deferring to a waiting writer, and the lock
+        // is free, make sure that writer is on its way in -- unless
+        // one already is, in which case waking another is wasted.
+        if (writer == NULL && readers == 0 && !writerWaking) {
+            writeQueue->WakeOne();
+            writerWaking = TRUE;
+        }
+        readQueue->Sleep();
+    }
+    readers++;
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReadRelease
+// 	Leave the readers.  If we were the last one, the lock is free,
+//	so let the next waiters in.
+//----------------------------------------------------------------------
+
+void
+RWLock::ReadRelease()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(readers > 0 && writer == NULL);
+    readers--;
+    if (readers == 0)
+        WakeWaiters();
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::WriteAcquire
+// 	Wait until no one holds the lock, then take it for ourselves.
+//----------------------------------------------------------------------
+
+void
+RWLock::WriteAcquire()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(writer != currentThread);
+    while (writer != NULL || readers > 0) {
+        writeQueue->Sleep();
+        writerWaking = FALSE;		// we were the one on the way
+    }
+    writer = currentThread;
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// RWLock::WriteRelease
+// 	Give up the lock, which we must hold for writing, and let the
+//	next waiters in.
+//----------------------------------------------------------------------
+
+void
+RWLock::WriteRelease()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(isWriteHeldByCurrentThread());
+    writer = NULL;
+    WakeWaiters();
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+bool
+RWLock::isWriteHeldByCurrentThread()
+{
+    return (writer == currentThread);
+}
+
+//----------------------------------------------------------------------
+// Barrier::Barrier
+// 	Initialize a barrier for "count" threads, at phase 0, with no
+//	one waiting.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+Barrier::Barrier(char* debugName, int threads)
+{
+    ASSERT(threads > 0);
+
+    name = debugName;
+    count = threads;
+    arrived = 0;
+    generation = 0;
+    queue = new WaitQueue(debugName);
+}
+
+//----------------------------------------------------------------------
+// Barrier::~Barrier
+// 	De-allocate a barrier, which must have no one waiting.
+//----------------------------------------------------------------------
+
+Barrier::~Barrier()
+{
+    ASSERT(queue->IsEmpty());
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// Barrier::Wait
+// 	Arrive at the barrier.  The last thread of a phase ends the phase
+//	and releases everyone else; the rest wait until their phase
+//	has ended.
+//
+// Returns:
+//	TRUE in the thread that arrived last, FALSE in all the others.
+//----------------------------------------------------------------------
+
+bool
+Barrier::Wait()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+    int myGeneration = generation;
+
+    if (++arrived == count) {		// last one in: end the phase
+        arrived = 0;
+        generation++;
+        queue->ReleaseAll();
+        (void) interrupt->SetLevel(oldLevel);
+        return TRUE;
+    }
+
+    while (generation == myGeneration)
+        queue->Sleep();
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::WaitGroup
+// 	Initialize a wait group, with nothing outstanding.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+WaitGroup::WaitGroup(char* debugName)
+{
+    name = debugName;
+    outstanding = 0;
+    finished = new List;
+    allDone = new WaitQueue(debugName);
+    anyDone = new WaitQueue(debugName);
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::~WaitGroup
+// 	De-allocate a wait group, which must have no one waiting.
+//----------------------------------------------------------------------
+
+WaitGroup::~WaitGroup()
+{
+    ASSERT(allDone->IsEmpty() && anyDone->IsEmpty());
+    delete finished;
+    delete allDone;
+    delete anyDone;
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::Add
+// 	Note that "n" more pieces of work are outstanding.
+//----------------------------------------------------------------------
+
+void
+WaitGroup::Add(int n)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    outstanding += n;
+    ASSERT(outstanding >= 0);
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::Done
+// 	Note that a piece of work has finished; if it was the last,
+//	wake everyone waiting for that, all at once.
+//----------------------------------------------------------------------
+
+void
+WaitGroup::Done()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    ASSERT(outstanding > 0);
+    if (--outstanding == 0)
+        (void) allDone->ReleaseAll();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::Finished
+// 	Called by Thread::Finish, with interrupts off, when a child
+//	forked into the group with "arg" is done: remember it for
+//	JoinAny, and count it Done.
+//----------------------------------------------------------------------
+
+void
+WaitGroup::Finished(int arg)
+{
+    finished->Append((void *) arg);
+    (void) anyDone->WakeOne();
+    Done();
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::Wait
+// 	Wait until nothing is outstanding.  Children that have finished
+//	count as joined, so JoinAny won't return them afterwards.
+//----------------------------------------------------------------------
+
+void
+WaitGroup::Wait()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    while (outstanding > 0)
+        allDone->Sleep();
+    while (!finished->IsEmpty())
+        (void) finished->Remove();
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// WaitGroup::JoinAny
+// 	Wait until a child forked into the group has finished, in the
+//	order they finish, and return the "arg" it was forked with.
+//	There must be one that JoinAny hasn't returned yet.
+//----------------------------------------------------------------------
+
+int
+WaitGroup::JoinAny()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int arg;
+
+    while (finished->IsEmpty()) {
+        ASSERT(outstanding > 0);	// or we would wait forever
+        anyDone->Sleep();
+    }
+    arg = (int) finished->Remove();
+    (void) interrupt->SetLevel(oldLevel);
+    return arg;
+}
+
+// Number of buckets in the parking lot's hash table.  Only threads that
+// are actually waiting occupy it, so it can be small.
+#define ParkingBuckets	61
+
+// Low bit of a CompactLock's word: threads are parked on the lock.
+// Thread objects are word aligned, so the bit is free in the owner.
+#define LockParkedBit	1UL
+
+//----------------------------------------------------------------------
+// ParkingLot::ParkingLot
+// 	Initialize the parking lot's hash table, with no one parked.
+//----------------------------------------------------------------------
+
+ParkingLot::ParkingLot()
+{
+    buckets = new ParkedQueue *[ParkingBuckets];
+    for (int i = 0; i < ParkingBuckets; i++)
+        buckets[i] = NULL;
+    numQueues = 0;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::~ParkingLot
+// 	De-allocate the hash table.  Queues are freed as they empty, so
+//	any left belong to threads still parked as Nachos halts; those
+//	are abandoned along with their threads.
+//----------------------------------------------------------------------
+
+ParkingLot::~ParkingLot()
+{
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::Find
+// 	Hash "address" to its bucket, and walk the bucket's chain to the
+//	queue for "address".
+//
+// Returns:
+//	The link pointing to that queue -- or, if there is none, the
+//	NULL link at the end of the chain, where it would be added.
+//----------------------------------------------------------------------
+
+ParkingLot::ParkedQueue **
+ParkingLot::Find(void *address)
+{
+    unsigned long hash = (unsigned long) address / sizeof(unsigned long);
+    ParkedQueue **link = &buckets[hash % ParkingBuckets];
+
+    while (*link != NULL && (*link)->address != address)
+        link = &(*link)->next;
+    return link;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::Lookup
+// 	Return the wait queue for "address".  If there is none, create
+//	one if "create" is TRUE, else return NULL.
+//----------------------------------------------------------------------
+
+WaitQueue *
+ParkingLot::Lookup(void *address, bool create)
+{
+    ParkedQueue **link = Find(address);
+
+    if (*link == NULL) {
+        if (!create)
+            return NULL;
+        *link = new ParkedQueue;
+        (*link)->address = address;
+        (*link)->queue = new WaitQueue("parked");
+        (*link)->next = NULL;
+        numQueues++;
+    }
+    return (*link)->queue;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::Vacate
+// 	If the queue for "address" is empty, unlink and free it.
+//----------------------------------------------------------------------
+
+void
+ParkingLot::Vacate(void *address)
+{
+    ParkedQueue **link = Find(address);
+    ParkedQueue *parked = *link;
+
+    if (parked != NULL && parked->queue->IsEmpty()) {
+        *link = parked->next;
+        delete parked->queue;
+        delete parked;
+        numQueues--;
+    }
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::Park
+// 	Block the current thread on "address", until it is unparked.
+//	Assumes interrupts are disabled.
+//----------------------------------------------------------------------
+
+void
+ParkingLot::Park(void *address)
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+
+    Lookup(address, TRUE)->Sleep();
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::UnparkOne
+// 	Wake the highest priority thread parked on "address".
+//
+// Returns:
+//	The thread woken up, NULL if no one was parked there.
+//----------------------------------------------------------------------
+
+Thread *
+ParkingLot::UnparkOne(void *address)
+{
+    WaitQueue *queue = Lookup(address, FALSE);
+    Thread *thread;
+
+    if (queue == NULL)
+        return NULL;
+    thread = queue->WakeOne();
+    Vacate(address);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::UnparkAll
+// 	Wake every thread parked on "address".
+//
+// Returns:
+//	The number of threads woken up.
+//----------------------------------------------------------------------
+
+int
+ParkingLot::UnparkAll(void *address)
+{
+    WaitQueue *queue = Lookup(address, FALSE);
+    int woken;
+
+    if (queue == NULL)
+        return 0;
+    woken = queue->ReleaseAll();
+    Vacate(address);
+    return woken;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::RequeueOne
+// 	Move the highest priority thread parked on "from" to "to",
+//	without waking it up.
+//
+// Returns:
+//	The thread moved, NULL if no one was parked on "from".
+//----------------------------------------------------------------------
+
+Thread *
+ParkingLot::RequeueOne(void *from, void *to)
+{
+    WaitQueue *queue = Lookup(from, FALSE);
+    Thread *thread;
+
+    if (queue == NULL)
+        return NULL;
+    thread = queue->MoveOne(Lookup(to, TRUE));
+    Vacate(from);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::RequeueAll
+// 	Move every thread parked on "from" to "to", without waking them.
+//
+// Returns:
+//	The number of threads moved.
+//----------------------------------------------------------------------
+
+int
+ParkingLot::RequeueAll(void *from, void *to)
+{
+    WaitQueue *queue = Lookup(from, FALSE);
+    int moved;
+
+    if (queue == NULL)
+        return 0;
+    moved = queue->MoveAll(Lookup(to, TRUE));
+    Vacate(from);
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// ParkingLot::HasParked
+// 	Return TRUE if any thread is parked on "address".
+//----------------------------------------------------------------------
+
+bool
+ParkingLot::HasParked(void *address)
+{
+    return (*Find(address) != NULL);
+}
+
+//----------------------------------------------------------------------
+// CompactLock::CompactLock
+// 	Initialize a compact lock to FREE: the whole of its state is the
+//	one word.
+//----------------------------------------------------------------------
+
+CompactLock::CompactLock()
+{
+    word = 0;
+}
+
+//----------------------------------------------------------------------
+// CompactLock::~CompactLock
+// 	A compact lock owns no memory; just check it isn't in use.
+//----------------------------------------------------------------------
+
+CompactLock::~CompactLock()
+{
+    ASSERT(word == 0);
+}
+
+//----------------------------------------------------------------------
+// CompactLock::Acquire
+// 	Wait until the lock is FREE, then make the current thread its
+//	owner.  A FREE lock is taken with one compare-and-swap; otherwise
+//	set the parked bit (so that Release looks in the parking lot) and
+//	park on the lock until Release hands it to us.
+//----------------------------------------------------------------------
+
+void
+CompactLock::Acquire()
+{
+    unsigned long me = (unsigned long) currentThread;
+
+    if (CompareAndSwap(&word, 0UL, me))
+        return;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    ASSERT((word & ~LockParkedBit) != me);	// not re-entrant
+    while (word != 0 && (word & ~LockParkedBit) != me) {
+        word |= LockParkedBit;
+        parkingLot->Park(this);
+    }
+    if (word == 0)				// FREE: take it ourselves
+        word = me | (parkingLot->HasParked(this) ? LockParkedBit : 0);
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// CompactLock::TryAcquire
+// 	Take the lock if it is FREE, without waiting.
+//
+// Returns:
+//	TRUE if we got the lock.
+//----------------------------------------------------------------------
+
+bool
+CompactLock::TryAcquire()
+{
+    return CompareAndSwap(&word, 0UL, (unsigned long) currentThread);
+}
+
+//----------------------------------------------------------------------
+// CompactLock::Release
+// 	Give up the lock.  If threads are parked on it, hand it straight
+//	to the highest priority one, keeping the parked bit if more are
+//	left; otherwise make it FREE.
+//----------------------------------------------------------------------
+
+void
+CompactLock::Release()
+{
+    unsigned long me = (unsigned long) currentThread;
+    Thread *next;
+
+    ASSERT(isHeldByCurrentThread());
+    if (CompareAndSwap(&word, me, 0UL))		// no one parked
+        return;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    next = parkingLot->UnparkOne(this);
+    if (next == NULL)
+        word = 0;
+    else
+        word = (unsigned long) next
+               | (parkingLot->HasParked(this) ? LockParkedBit : 0);
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+bool
+CompactLock::isHeldByCurrentThread()
+{
+    return ((word & ~LockParkedBit) == (unsigned long) currentThread);
+}
+
+//----------------------------------------------------------------------
+// CompactCondition::CompactCondition
+// 	Initialize a compact condition variable, with no one waiting.
+//----------------------------------------------------------------------
+
+CompactCondition::CompactCondition()
+{
+    waiters = 0;
+}
+
+CompactCondition::~CompactCondition()
+{
+    ASSERT(waiters == 0);
+}
+
+//----------------------------------------------------------------------
+// CompactCondition::Wait
+// 	Release the lock and park on the condition, atomically.  Signal
+//	moves us onto the lock's address, so when we are woken up, the
+//	lock has been handed to us.
+//----------------------------------------------------------------------
+
+void
+CompactCondition::Wait(CompactLock *conditionLock)
+{
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    waiters++;
+    conditionLock->Release();
+    parkingLot->Park(this);
+    ASSERT(conditionLock->isHeldByCurrentThread());
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// CompactCondition::Signal
+// 	Move the highest priority waiter, if any, onto the lock's address,
+//	and mark the lock as having parked threads, so that Release hands
+//	the lock to it.
+//----------------------------------------------------------------------
+
+void
+CompactCondition::Signal(CompactLock *conditionLock)
+{
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    if (waiters == 0)
+        return;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (parkingLot->RequeueOne(this, conditionLock) != NULL) {
+        waiters--;
+        conditionLock->word |= LockParkedBit;
+    }
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// CompactCondition::Broadcast
+// 	Move every waiter onto the lock's address, to be handed the lock
+//	in turn.
+//----------------------------------------------------------------------
+
+void
+CompactCondition::Broadcast(CompactLock *conditionLock)
+{
+    ASSERT(conditionLock->isHeldByCurrentThread());
+    if (waiters == 0)
+        return;
+
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    waiters -= parkingLot->RequeueAll(this, conditionLock);
+    conditionLock->word |= LockParkedBit;
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Selectable::Selectable
+// 	Initialize a message source, with no one selecting on it.
+//----------------------------------------------------------------------
+
+Selectable::Selectable()
+{
+    selectors = NULL;
+}
+
+Selectable::~Selectable()
+{
+    ASSERT(selectors == NULL);
+}
+
+//----------------------------------------------------------------------
+// Selectable::NotifySelectors
+// 	Wake every thread selecting on this source, now that it is
+//	ready.  They take themselves off the list when they wake up.
+//----------------------------------------------------------------------
+
+void
+Selectable::NotifySelectors()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    for (SelectEntry *entry = selectors; entry != NULL; entry = entry->next)
+        (void) entry->select->waiter->WakeAll();
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Select::Select
+// 	Initialize an empty set of sources to select on.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+Select::Select(char* debugName)
+{
+    name = debugName;
+    maxSources = 4;
+    entries = new SelectEntry[maxSources];
+    numSources = 0;
+    lastReady = -1;
+    waiter = new WaitQueue(debugName);
+}
+
+Select::~Select()
+{
+    delete waiter;			// asserts that no one is waiting
+    delete [] entries;
+}
+
+//----------------------------------------------------------------------
+// Select::Add
+// 	Add "source" to the set, and return the index Wait will return
+//	for it.  Not while a thread is waiting on the set.
+//----------------------------------------------------------------------
+
+int
+Select::Add(Selectable *source)
+{
+    ASSERT(waiter->IsEmpty());
+    if (numSources == maxSources) {
+        SelectEntry *old = entries;
+
+        maxSources *= 2;
+        entries = new SelectEntry[maxSources];
+        for (int i = 0; i < numSources; i++)
+            entries[i] = old[i];
+        delete [] old;
+    }
+    entries[numSources].select = this;
+    entries[numSources].source = source;
+    entries[numSources].prev = entries[numSources].next = NULL;
+    return numSources++;
+}
+
+//----------------------------------------------------------------------
+// Select::FindReady
+// 	Return the index of a ready source, or -1 if there are none.
+//	The scan starts after the one returned last time, so that a
+//	busy source can't starve the others.
+//----------------------------------------------------------------------
+
+int
+Select::FindReady()
+{
+    int i = lastReady;
+
+    for (int n = 0; n < numSources; n++) {
+        i = (i + 1) % numSources;
+        if (entries[i].source->IsReady())
+            return lastReady = i;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Select::Block
+// 	Wait until a source is ready, for up to "ticks" ticks (forever
+//	if "ticks" < 0).  Register on every source, sleep until one of
+//	them notifies us (or time runs out), then deregister from them
+//	all.  Return the index of a ready source, or -1.
+//
+//	Interrupts are assumed to be off.
+//----------------------------------------------------------------------
+
+int
+Select::Block(int ticks)
+{
+    int deadline = stats->totalTicks + ticks;
+    int ready;
+    SelectEntry *entry;
+
+    while ((ready = FindReady()) < 0) {
+        if (ticks >= 0 && deadline <= stats->totalTicks)
+            break;				// timed out
+
+        for (int i = 0; i < numSources; i++) {
+            entry = &entries[i];
+            entry->prev = NULL;
+            entry->next = entry->source->selectors;
+            if (entry->next != NULL)
+                entry->next->prev = entry;
+            entry->source->selectors = entry;
+        }
+
+        if (ticks < 0)
+            waiter->Sleep();
+        else
+            (void) waiter->Sleep(deadline - stats->totalTicks);
+
+        for (int i = 0; i < numSources; i++) {
+            entry = &entries[i];
+            if (entry->prev != NULL)
+                entry->prev->next = entry->next;
+            else
+                entry->source->selectors = entry->next;
+            if (entry->next != NULL)
+                entry->next->prev = entry->prev;
+            entry->prev = entry->next = NULL;
+        }
+    }
+    return ready;
+}
+
+//----------------------------------------------------------------------
+// Select::Wait
+// 	Return the index of a source that is ready, waiting until there
+//	is one -- for at most "ticks" ticks, if given, returning -1 if
+//	none got ready in that time.
+//----------------------------------------------------------------------
+
+int
+Select::Wait()
+{
+    int ready;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    ASSERT(waiter->IsEmpty());		// one selecting thread at a time
+    ready = Block(-1);
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return ready;
+}
+
+int
+Select::Wait(int ticks)
+{
+    int ready;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    ASSERT(waiter->IsEmpty());		// one selecting thread at a time
+    ready = Block((ticks > 0) ? ticks : 0);
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return ready;
+}
+
+//----------------------------------------------------------------------
+// Select::Poll
+// 	Return the index of a source that is ready, or -1, without
+//	waiting.
+//----------------------------------------------------------------------
+
+int
+Select::Poll()
+{
+    int ready;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
 
-    // Once Lock is free, make current thread the lock owner and
-    // change the lock's status to held.
-    lockOwner = currentThread;
-    held = true;
+    ready = FindReady();
 
-    (void) interrupt->SetLevel(oldLevel);   // re-enable interrupts
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return ready;
 }
-void Lock::Release() {
-    // Make sure that the lock is held by the current thread.
-    ASSERT(isHeldByCurrentThread());
-    Thread *thread;
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
 
-    thread = (Thread *)queue->Remove();
-    if (thread != NULL)    // make thread ready, consuming the V immediately
-        scheduler->ReadyToRun(thread);
-    lockOwner = NULL;
-    held=false;
+//----------------------------------------------------------------------
+// MessageBuffer::getData
+// 	Return the buffer's payload, which only its owner may use.
+//----------------------------------------------------------------------
 
-    (void) interrupt->SetLevel(oldLevel); // re-enable interrupts
+char *
+MessageBuffer::getData()
+{
+    ASSERT(owner == currentThread);
+    return data;
 }
 
-bool Lock::isHeldByCurrentThread(){
-    return (currentThread==lockOwner);
+//----------------------------------------------------------------------
+// MessageBuffer::setLength
+// 	Set how many bytes of the payload are in use.  Only the owner
+//	may do this.
+//----------------------------------------------------------------------
 
+void
+MessageBuffer::setLength(int bytes)
+{
+    ASSERT(owner == currentThread);
+    ASSERT(bytes >= 0 && bytes <= size);
+    length = bytes;
 }
 
-Condition::Condition(char* debugName) {
+//----------------------------------------------------------------------
+// BufferPool::BufferPool
+// 	Initialize a pool of free message buffers.  The storage for all
+//	of them is allocated here, at once, so that sending a message
+//	never has to.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"count" is how many buffers the pool has.
+//	"bufferSize" is the size of each one's payload, in bytes.
+//----------------------------------------------------------------------
+
+BufferPool::BufferPool(char* debugName, int count, int bufferSize)
+{
+    ASSERT(count > 0 && bufferSize > 0);
     name = debugName;
-    waitingList = new List;
-}
-Condition::~Condition() {
-    // Check to see if the waiting list is empty before allowing
-    // deletion of the condition variable
-    ASSERT(waitingList->IsEmpty());
-    delete waitingList;
+    numBuffers = count;
+    storage = new char[count * bufferSize];
+    buffers = new MessageBuffer[count];
+    freeList = NULL;
+    for (int i = count - 1; i >= 0; i--) {
+        buffers[i].data = storage + i * bufferSize;
+        buffers[i].size = bufferSize;
+        buffers[i].length = 0;
+        buffers[i].owner = NULL;
+        buffers[i].pool = this;
+        buffers[i].nextFree = freeList;
+        freeList = &buffers[i];
+    }
+    numFree = count;
+    waiting = new WaitQueue(debugName);
 }
-void Condition::Wait(Lock* conditionLock) {
-    ASSERT(conditionLock->isHeldByCurrentThread());
-    IntStatus oldLevel = interrupt->SetLevel(IntOff);   // disable interrupts
-    // Release the lock
-    conditionLock->Release();
-    // Place the calling thread on the condition variable's waiting list
-    waitingList->SortedInsert((void *)currentThread, currentThread->getPriority()*(-1));
-    // Suspend the execution of the calling thread
-    currentThread->Sleep();
 
-    // When it wakes up, reacquire the lock
-    conditionLock->Acquire();
+//----------------------------------------------------------------------
+// BufferPool::~BufferPool
+// 	De-allocate the pool, once every buffer has been freed.
+//----------------------------------------------------------------------
 
-    // Re-enable interrupts
-    (void) interrupt->SetLevel(oldLevel);
+BufferPool::~BufferPool()
+{
+    ASSERT(numFree == numBuffers);
+    delete waiting;
+    delete [] buffers;
+    delete [] storage;
 }
-void Condition::Signal(Lock* conditionLock) {
-    // Check to see if the list is empty
-    if(!waitingList->IsEmpty()){
-        ASSERT(conditionLock->isHeldByCurrentThread());
 
-        Thread *thread;
+//----------------------------------------------------------------------
+// BufferPool::Allocate
+// 	Wait until a buffer is free, then take it, empty, and make the
+//	current thread its owner.
+//----------------------------------------------------------------------
 
-        // Disable interrupts
-        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+MessageBuffer *
+BufferPool::Allocate()
+{
+    MessageBuffer *buffer;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
 
-        // Calls one thread off the condition variable's witing list
-        // And marks it as eligible to run
-        thread = (Thread *)waitingList->Remove();
-        if (thread != NULL)    // make thread ready, consuming the V immediately
-            scheduler->ReadyToRun(thread);
+    while (freeList == NULL)
+        waiting->Sleep();
+    buffer = TryAllocate();
 
-        // Re-enable interrupts
-        (void) interrupt->SetLevel(oldLevel);
-    }
-    else{
-        printf("There were no waiters\n");
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return buffer;
+}
+
+//----------------------------------------------------------------------
+// BufferPool::TryAllocate
+// 	Take a free buffer, as Allocate does, or return NULL, without
+//	waiting, if there isn't one.
+//----------------------------------------------------------------------
+
+MessageBuffer *
+BufferPool::TryAllocate()
+{
+    MessageBuffer *buffer;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    buffer = freeList;
+    if (buffer != NULL) {
+        freeList = buffer->nextFree;
+        numFree--;
+        buffer->nextFree = NULL;
+        buffer->length = 0;
+        buffer->owner = currentThread;
     }
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return buffer;
 }
-void Condition::Broadcast(Lock* conditionLock) {
-    // Check to see if the list is empty
-    if(!waitingList->IsEmpty()){
-        ASSERT(conditionLock->isHeldByCurrentThread());
 
-        Thread *thread;
+//----------------------------------------------------------------------
+// BufferPool::Free
+// 	Give back a buffer the current thread owns, waking a thread
+//	waiting for one, if any.
+//----------------------------------------------------------------------
 
-        // Disable interrupts
-        IntStatus oldLevel = interrupt->SetLevel(IntOff);
+void
+BufferPool::Free(MessageBuffer *buffer)
+{
+    ASSERT(buffer->pool == this && buffer->owner == currentThread);
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
 
-        // Take all threads off the condition variable's waiting list
-        // and marks them as eligible to run.
-        thread = (Thread *)waitingList->Remove();
-        while(thread != NULL){
-            scheduler->ReadyToRun(thread);
-            thread = (Thread *)waitingList->Remove();
-        }
+    buffer->owner = NULL;
+    buffer->nextFree = freeList;
+    freeList = buffer;
+    numFree++;
+    (void) waiting->WakeOne();
 
-        // Re-enable the interrupts
-        (void) interrupt->SetLevel(oldLevel);
-    }
-    else{
-        // Used for testing purposed to notify that the 
-        // waiting list was empty.
-        printf("There were no waiters\n");
-    }
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
 }
 
 Mailbox::Mailbox(){
@@ -236,6 +2108,7 @@ Mailbox::Mailbox(){
     msg = new List;
     senders = 0;
     receivers = 0;
+    waitingSenders = 0;
 }
 
 Mailbox::~Mailbox(){
@@ -245,25 +2118,48 @@ Mailbox::~Mailbox(){
 }
 
 void Mailbox::Send(int message){
+    Deliver((void *) message);
+}
+
+void Mailbox::Receive(int *message){
+    *message = (int) Collect();
+}
+
+void Mailbox::Send(MessageBuffer *buffer){
+    // Give up the buffer before anyone else can own it.
+    ASSERT(buffer->owner == currentThread);
+    buffer->owner = NULL;
+    Deliver((void *) buffer);
+}
+
+void Mailbox::Receive(MessageBuffer **buffer){
+    *buffer = (MessageBuffer *) Collect();
+    (*buffer)->owner = currentThread;
+}
+
+void Mailbox::Deliver(void *item){
     // Acquire lock for mutual exclusion
     mailboxLock->Acquire();
-    // Increment the amount of senders
-    senders++;
-    // If there are no receivers waiting, place the thread to sleep
-    if(receivers==0){
-        //printf("Send is going to sleep\n");
-        send_msg->Wait(mailboxLock);
-        //printf("Send woke up\n");
-    }
 
-    // Decrement the number of receivers since we will be sending
-    // a message to a receiver that is waiting
-    receivers--;
-    // printf("Sending the message\n");
+    // If no receiver is waiting for a message, place the thread to
+    // sleep until one comes for us.  "senders" counts the waiting
+    // senders a receiver has come for; any of them may deliver, so
+    // if another sender takes the slot first, we just sleep again.
+    if (receivers == 0) {
+        if (++waitingSenders == 1)
+            NotifySelectors();	// we're ready to be received
+        while (senders == 0)
+            send_msg->Wait(mailboxLock);
+        senders--;
+    } else {
+        // Decrement the number of receivers since we will be sending
+        // a message to a receiver that is waiting
+        receivers--;
+    }
 
     // Send the message, and signal the Receive condition variable
     // to wake up the sleeping receive thread
-    msg->Append((void *) message);
+    msg->Append(item);
     receive_msg->Signal(mailboxLock);
 
     // Release lock
@@ -271,36 +2167,248 @@ void Mailbox::Send(int message){
 }
 
 
-void Mailbox::Receive(int *message){
+void *Mailbox::Collect(){
+    void *item;
+
     // Acquire lock for mutual exclusion
     mailboxLock->Acquire();
 
-    // Increment the amount of receivers available
-    receivers++;
+    // Wake up a send thread if there is a send waiting for a
+    // receive; otherwise wait for the next sender to find us.
+    if (waitingSenders > 0) {
+        waitingSenders--;	// that one is ours now
+        senders++;
+        send_msg->Signal(mailboxLock);
+    } else
+        receivers++;
 
-    // Wake up the send thread if there is a send waiting
-    // for a receive.
-    send_msg->Signal(mailboxLock);
-
-    // If there is no senders waiting, place the receive to sleep.
-    receive_msg->Wait(mailboxLock);
-
-    // Once awaken, do a second check (this is for when receive is
-    // called before send)
-    if(senders==0){
-        //printf("Receive is going to sleep\n");
+    // Sleep until there is a message.  Every message was sent for
+    // some receiver, so if another one takes it first, ours is
+    // still to come.
+    while (msg->IsEmpty())
         receive_msg->Wait(mailboxLock);
-    }
-
-    // Decrement the amount of senders since receive will be
-    // receive a message from the sender
-    senders--;
 
     // Receive the message, change the value of the passed
     // message pointer, and release the lock.
     printf("Receiving the message\n");
-    *message = (int) (msg->Remove());
+    item = msg->Remove();
     mailboxLock->Release();
+    return item;
+}
+
+//----------------------------------------------------------------------
+// Channel::Channel
+// 	Initialize an empty channel.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"slots" is how many messages the channel can buffer.
+//----------------------------------------------------------------------
+
+Channel::Channel(char* debugName, int slots)
+{
+    ASSERT(slots > 0);
+    name = debugName;
+    capacity = slots;
+    buffer = new int[capacity];
+    head = 0;
+    count = 0;
+    senders = new WaitQueue(debugName);
+    receivers = new WaitQueue(debugName);
+}
+
+//----------------------------------------------------------------------
+// Channel::~Channel
+// 	De-allocate a channel, when no one is waiting on it.  Any
+//	messages still in it are lost.
+//----------------------------------------------------------------------
+
+Channel::~Channel()
+{
+    ASSERT(senders->IsEmpty() && receivers->IsEmpty());
+    delete senders;
+    delete receivers;
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// Channel::Put
+// 	Append "n" messages, for which there must be room.  If the
+//	channel was empty, wake up to "n" receivers to take them.
+//
+//	Interrupts are assumed to be off.
+//----------------------------------------------------------------------
+
+void
+Channel::Put(int *messages, int n)
+{
+    bool wasEmpty = (count == 0);
+
+    ASSERT(n <= capacity - count);
+    for (int i = 0; i < n; i++)
+        buffer[(head + count + i) % capacity] = messages[i];
+    count += n;
+    if (wasEmpty) {
+        (void) receivers->WakeN(n);
+        NotifySelectors();
+    }
+}
+
+//----------------------------------------------------------------------
+// Channel::Take
+// 	Remove the "n" oldest messages, which must be there.  If the
+//	channel was full, wake up to "n" senders to fill the room.
+//
+//	Interrupts are assumed to be off.
+//----------------------------------------------------------------------
+
+void
+Channel::Take(int *messages, int n)
+{
+    bool wasFull = (count == capacity);
+
+    ASSERT(n <= count);
+    for (int i = 0; i < n; i++)
+        messages[i] = buffer[(head + i) % capacity];
+    head = (head + n) % capacity;
+    count -= n;
+    if (wasFull)
+        (void) senders->WakeN(n);
+}
+
+//----------------------------------------------------------------------
+// Channel::Send
+// 	Wait until there is room in the channel, then append "message".
+//	If there is still room, pass the wakeup on to the next sender.
+//----------------------------------------------------------------------
+
+void
+Channel::Send(int message)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    while (count == capacity)
+        senders->Sleep();
+    Put(&message, 1);
+    if (count < capacity && !senders->IsEmpty())
+        (void) senders->WakeOne();
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Channel::Receive
+// 	Wait until there is a message in the channel, then take the
+//	oldest one into "message".  If there are more, pass the wakeup
+//	on to the next receiver.
+//----------------------------------------------------------------------
+
+void
+Channel::Receive(int *message)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    while (count == 0)
+        receivers->Sleep();
+    Take(message, 1);
+    if (count > 0 && !receivers->IsEmpty())
+        (void) receivers->WakeOne();
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Channel::TrySend
+// 	Append "message" if there is room; return FALSE, without
+//	waiting, if the channel is full.
+//----------------------------------------------------------------------
+
+bool
+Channel::TrySend(int message)
+{
+    bool sent = FALSE;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    if (count < capacity) {
+        Put(&message, 1);
+        sent = TRUE;
+    }
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return sent;
+}
+
+//----------------------------------------------------------------------
+// Channel::TryReceive
+// 	Take the oldest message into "message" if there is one; return
+//	FALSE, without waiting, if the channel is empty.
+//----------------------------------------------------------------------
+
+bool
+Channel::TryReceive(int *message)
+{
+    bool received = FALSE;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    if (count > 0) {
+        Take(message, 1);
+        received = TRUE;
+    }
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return received;
+}
+
+//----------------------------------------------------------------------
+// Channel::SendN
+// 	Append all "n" of "messages", in order, as many at a time as
+//	there is room for.  Other senders' messages may come in between
+//	if we have to wait for room.
+//----------------------------------------------------------------------
+
+void
+Channel::SendN(int *messages, int n)
+{
+    int chunk;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    while (n > 0) {
+        while (count == capacity)
+            senders->Sleep();
+        chunk = capacity - count;
+        if (chunk > n)
+            chunk = n;
+        Put(messages, chunk);
+        messages += chunk;
+        n -= chunk;
+    }
+    if (count < capacity && !senders->IsEmpty())
+        (void) senders->WakeOne();
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+}
+
+//----------------------------------------------------------------------
+// Channel::ReceiveN
+// 	Wait until there is a message in the channel, then take as many
+//	as there are, up to "n", into "messages".  Return how many.
+//----------------------------------------------------------------------
+
+int
+Channel::ReceiveN(int *messages, int n)
+{
+    int chunk;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    ASSERT(n > 0);
+    while (count == 0)
+        receivers->Sleep();
+    chunk = (count < n) ? count : n;
+    Take(messages, chunk);
+    if (count > 0 && !receivers->IsEmpty())
+        (void) receivers->WakeOne();
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return chunk;
 }
 
 Whale::Whale(char* debugName){
@@ -396,3 +2504,140 @@ void Whale::Matchmaker(){
     }
     whaleLock->Release();
 }
+
+//----------------------------------------------------------------------
+// Rendezvous::Rendezvous
+// 	Initialize a rendezvous, with no one waiting.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//	"roles" is how many roles there are.
+//	"roleArity" is how many threads of each role make up a group; if
+//		it isn't given, a group is one thread of each role.
+//----------------------------------------------------------------------
+
+Rendezvous::Rendezvous(char* debugName, int roles)
+{
+    Setup(debugName, roles, NULL);
+}
+
+Rendezvous::Rendezvous(char* debugName, int roles, int *roleArity)
+{
+    Setup(debugName, roles, roleArity);
+}
+
+void
+Rendezvous::Setup(char* debugName, int roles, int *roleArity)
+{
+    ASSERT(roles > 0);
+    name = debugName;
+    numRoles = roles;
+    arity = new int[numRoles];
+    offset = new int[numRoles];
+    first = new RendezvousWaiter *[numRoles];
+    last = new RendezvousWaiter *[numRoles];
+    waiting = new int[numRoles];
+    groupSize = 0;
+    for (int r = 0; r < numRoles; r++) {
+        arity[r] = (roleArity == NULL) ? 1 : roleArity[r];
+        ASSERT(arity[r] > 0);
+        offset[r] = groupSize;
+        groupSize += arity[r];
+        first[r] = last[r] = NULL;
+        waiting[r] = 0;
+    }
+    rolesShort = numRoles;
+    matches = 0;
+    group = new RendezvousWaiter *[groupSize];
+}
+
+//----------------------------------------------------------------------
+// Rendezvous::~Rendezvous
+// 	De-allocate a rendezvous, when no one is waiting in it.
+//----------------------------------------------------------------------
+
+Rendezvous::~Rendezvous()
+{
+    for (int r = 0; r < numRoles; r++)
+        ASSERT(waiting[r] == 0);
+    delete [] group;
+    delete [] waiting;
+    delete [] last;
+    delete [] first;
+    delete [] offset;
+    delete [] arity;
+}
+
+//----------------------------------------------------------------------
+// Rendezvous::Arrive
+// 	Wait in "role" until a group that includes us is complete, and
+//	return the group's match number.
+//
+//	"value" is what we contribute to the group.
+//	"values", if not NULL, gets the values of the whole group --
+//		getGroupSize() of them, ordered by role and then by
+//		arrival.
+//----------------------------------------------------------------------
+
+int
+Rendezvous::Arrive(int role)
+{
+    return Arrive(role, 0, NULL);
+}
+
+int
+Rendezvous::Arrive(int role, int value, int *values)
+{
+    RendezvousWaiter me, *w;
+    int i, j, r;
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);	// disable interrupts
+
+    ASSERT(role >= 0 && role < numRoles);
+    me.thread = currentThread;
+    me.value = value;
+    me.values = values;
+    me.match = -1;
+    me.next = NULL;
+    if (last[role] == NULL)
+        first[role] = &me;
+    else
+        last[role]->next = &me;
+    last[role] = &me;
+    if (++waiting[role] == arity[role])
+        rolesShort--;
+
+    if (rolesShort > 0) {		// the group isn't complete yet
+        currentThread->Sleep();		// the thread completing it
+        (void) interrupt->SetLevel(oldLevel);	// wakes us, matched
+        return me.match;
+    }
+
+    // We complete a group: take the first arrivals of each role.  We
+    // are one of them, since our role only just reached its arity.
+    for (r = 0; r < numRoles; r++) {
+        for (i = 0; i < arity[r]; i++) {
+            w = first[r];
+            first[r] = w->next;
+            group[offset[r] + i] = w;
+        }
+        if (first[r] == NULL)
+            last[r] = NULL;
+        waiting[r] -= arity[r];
+        if (waiting[r] < arity[r])
+            rolesShort++;
+    }
+
+    // Hand out the values, then release the group all at once.
+    for (i = 0; i < groupSize; i++) {
+        w = group[i];
+        w->match = matches;
+        if (w->values != NULL)
+            for (j = 0; j < groupSize; j++)
+                w->values[j] = group[j]->value;
+        if (w != &me)
+            scheduler->ReadyToRun(w->thread);
+    }
+    matches++;
+
+    (void) interrupt->SetLevel(oldLevel);	// re-enable interrupts
+    return me.match;
+}
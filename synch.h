@@ -22,6 +22,118 @@
 #include "thread.h"
 #include "list.h"
 
+// The following class defines a "wait queue" -- the threads blocked on
+// a synchronization object, highest priority first (FIFO among equal
+// priorities).  Every primitive in this file parks its waiters on a
+// WaitQueue, so they all share the same O(log n) priority queue and
+// follow Thread::setPriority while they wait.
+//
+//	Sleep() -- put the current thread on the queue and block it;
+//		with a timeout, give up waiting after that many ticks
+//
+//	WakeOne() -- take the highest priority waiter off the queue and
+//		make it ready to run
+//
+//	WakeAll(), WakeN() -- the same, for every waiter, or up to n
+//
+//	ReleaseAll() -- wake every waiter, in no particular order, in
+//		O(n) time; the ready list sorts them by priority anyway
+//
+//	Peek() -- the highest priority waiter, left on the queue
+//
+//	MoveOne(), MoveAll() -- move the highest priority waiter, or
+//		every waiter, onto another WaitQueue, still asleep
+//
+// As with Thread::Sleep and Scheduler::ReadyToRun, the caller must
+// have interrupts disabled; the wait queue is only the mechanism, the
+// caller supplies the atomicity.
+
+class WaitQueue {
+public:
+    WaitQueue(char* debugName);		// initialize to "no one waiting"
+    ~WaitQueue();			// de-allocate; must be empty
+    char* getName() {
+        return name;   // debugging assist
+    }
+
+    void Sleep();		// block currentThread on this queue
+    bool Sleep(int timeout);	// the same, for at most "timeout" ticks;
+				// FALSE if it timed out
+    Thread *WakeOne();		// wake highest priority waiter, if any
+    int WakeAll();		// wake every waiter, return how many
+    int WakeN(int n);		// wake up to n waiters, return how many
+    int ReleaseAll();		// wake every waiter, unordered
+    Thread *Peek();		// highest priority waiter, or NULL
+    Thread *MoveOne(WaitQueue *dest);	// requeue first waiter on "dest"
+    int MoveAll(WaitQueue *dest);	// requeue every waiter on "dest"
+
+    bool IsEmpty();		// is anyone waiting?
+    int NumWaiting();		// how many threads are waiting
+
+private:
+    char* name;			// useful for debugging
+    PriorityHeap *queue;	// the waiting threads
+};
+
+// The following classes define a "lock profiler", which keeps contention
+// statistics for every Lock and Condition, when Nachos is run with -lp.
+// Statistics are kept per debugging name, so that all the locks created
+// with the same name (one per thread, say) add up in one record:
+//
+//	for a Lock -- acquisitions, how many had to wait, total and
+//		longest wait in ticks, how many different threads waited,
+//		and a histogram of hold times (powers of two of ticks)
+//
+//	for a Condition -- Waits, Signals and Broadcasts, total and
+//		longest time spent in Wait, and how many different
+//		threads waited
+//
+// Each Lock or Condition looks its record up once, when it is created,
+// and keeps a pointer to it (NULL when profiling is off), so the cost of
+// profiling is a few counter updates per operation.  Cleanup prints
+// the records, most total wait first.
+
+#define HoldBuckets	16	// hold-time histogram: 0, 1, 2-3, 4-7, ...
+
+class LockStats {
+public:
+    LockStats(char* debugName, bool condition);
+    ~LockStats();
+
+    void NoteWait(Thread *waiter, int ticks);	// a thread waited "ticks"
+    void NoteHold(int ticks);			// lock was held "ticks"
+    void Print();				// one line of the report
+
+    char* name;			// debugging name of the lock or condition
+    bool isCondition;		// a Condition, rather than a Lock?
+    int operations;		// Lock: acquisitions; Condition: Waits
+    int contended;		// Lock: acquisitions that had to wait
+    int signals;		// Condition: Signals and Broadcasts
+    int totalWait;		// ticks spent waiting, all told
+    int maxWait;		// longest single wait
+    int holdHistogram[HoldBuckets];	// Lock: hold times, by log2 ticks
+    int numWaiters;		// different threads that have waited
+    LockStats *next;		// next record in the same hash bucket
+
+private:
+    Thread **waiters;		// hash set of the threads that waited
+    int waiterSlots;		// size of "waiters"
+};
+
+class LockProfiler {
+public:
+    LockProfiler();		// start with no records
+    ~LockProfiler();
+
+    LockStats *Lookup(char* debugName, bool condition);
+				// find or create a record
+    void Print();		// print the report, most contended first
+
+private:
+    LockStats **buckets;	// hash table of records, by name
+    int numRecords;		// records in the table
+};
+
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
 //
@@ -29,6 +141,13 @@
 //
 //	V() -- increment, waking up a thread waiting in P() if necessary
 //
+// P(ticks) gives up if the value stays 0 for "ticks" ticks, and
+// returns FALSE; P(0) just checks.  It returns TRUE if it decremented.
+//
+// TryP() never waits: it decrements the value with a compare-and-swap
+// if it is > 0, and returns FALSE otherwise, without disabling
+// interrupts or touching the wait queue.
+//
 // Note that the interface does *not* allow a thread to read the value of
 // the semaphore directly -- even if you did read the value, the
 // only thing you would know is what the value used to be.  You don't
@@ -36,6 +155,15 @@
 // into a register, a context switch might have occurred,
 // and some other thread might have called P or V, so the true value might
 // now be different.
+//
+// By default V() only increments the value, and the thread it wakes
+// up competes for the unit when it runs: another thread may "barge"
+// in and take it first, so the waiter has to go back to sleep.  That
+// wakeup is counted as wasted (see getWastedWakeups()).  After
+// setHandoff(TRUE), V() instead hands its unit straight to the highest
+// priority thread waiting in P(), if there is one, rather than adding
+// it to the value.  Then no other thread can take the unit before the
+// waiter gets to run, and every wakeup is productive.
 
 class Semaphore {
 public:
@@ -47,11 +175,22 @@ public:
 
     void P();	 // these are the only operations on a semaphore
     void V();	 // they are both *atomic*
+    bool P(int ticks);	// P, giving up after "ticks" ticks
+    bool TryP();	// P, only if it need not wait
+
+    void setHandoff(bool on) {
+        handoff = on;	// hand units straight to waiters?
+    }
+    int getWastedWakeups() {
+        return wastedWakeups;	// waiters woken only to sleep again
+    }
 
 private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List *queue;       // threads waiting in P() for the value to be > 0
+    WaitQueue *queue;  // threads waiting in P() for the value to be > 0
+    bool handoff;      // V() gives its unit directly to a waiter
+    int wastedWakeups; // times a woken waiter found value == 0
 };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -62,9 +201,28 @@ private:
 //	Release -- set lock to be FREE, waking up a thread waiting
 //		in Acquire if necessary
 //
+// Acquire(ticks) gives up if the lock is not ours within "ticks"
+// ticks, and returns FALSE.  TryAcquire() takes the lock only if it
+// is FREE, with a single compare-and-swap, and otherwise returns FALSE
+// at once.
+//
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).
+//
+// Most acquisitions find the lock FREE, so the lock state is kept in
+// one word that Acquire and Release try to flip with a single
+// compare-and-swap.  Only if that fails -- the lock is BUSY, or has
+// threads WAITING for it -- do they disable interrupts and use the
+// wait queue.
+//
+// As with semaphores, by default Release lets the lock go FREE, so that
+// a running thread can barge in and take it before the waiter it woke
+// runs; that gives more throughput, at the cost of wasted wakeups.
+// After setHandoff(TRUE), Release hands the lock directly to the
+// highest priority waiter, which wakes up already holding it.
+
+enum LockState { LOCK_FREE, LOCK_BUSY, LOCK_WAITING };
 
 class Lock {
 public:
@@ -76,31 +234,101 @@ public:
 
     void Acquire(); // these are the only operations on a lock
     void Release(); // they are both *atomic*
+    bool Acquire(int ticks);	// Acquire, giving up after "ticks" ticks
+    bool TryAcquire();		// Acquire, only if the lock is FREE
 
     bool isHeldByCurrentThread();	// true if the current thread
     // holds this lock.  Useful for
     // checking in Release, and in
     // Condition variable ops below.
 
-private:
+    void setHandoff(bool on) {
+        handoff = on;	// hand the lock straight to a waiter?
+    }
+    int getWastedWakeups() {
+        return wastedWakeups;	// waiters woken only to sleep again
+    }
+
+protected:
+    friend class Condition;	// moves its waiters onto our queue
+
+    bool WaitToAcquire(int ticks);	// slow path of Acquire: block until
+				// the lock is FREE or handed to us,
+				// for "ticks" (< 0 means forever)
+    void NoteAcquired(int waitStart);	// profile an acquisition; it
+				// waited since "waitStart", if >= 0
+
     char* name;				// for debugging
-    bool held;               // Boolean to see if the lock is held
-    List *queue;            // threads waiting for lock to be free
+    int state;               // LOCK_FREE, LOCK_BUSY, or LOCK_WAITING
+    // (busy, and threads may be queued)
+    WaitQueue *queue;       // threads waiting for lock to be free
     Thread *lockOwner;      // The current owner of the lock
+    bool handoff;           // Release passes ownership to a waiter
+    int wastedWakeups;      // times a woken waiter found the lock taken
+    LockStats *profile;     // contention statistics, NULL if not kept
+    int acquiredAt;         // when the owner got the lock, if profiled
     // plus some other stuff you'll need to define
 };
 
+// The following class defines an "adaptive lock" -- a Lock that, when
+// it finds the lock busy while the owner is running on another CPU,
+// spins for a while instead of going to sleep at once.  A holder that
+// is running will usually release the lock sooner than a sleep and a
+// wakeup would take.  If the owner is not running (or stops running),
+// spinning cannot help, so the thread blocks as in Lock::Acquire.
+//
+// The spin uses exponential backoff between looks at the lock, and
+// its length tunes itself: a lock that is usually won by spinning is
+// allowed to spin a bit longer than the spins it took; a lock that
+// usually makes us give up spins less.  The counts are kept per lock
+// so the tuning can be judged with PrintStats().
+//
+// Nachos itself is a uniprocessor: the owner of a busy lock is never
+// RUNNING while we are, so here an AdaptiveLock always blocks after a
+// single look at the owner.  The spinning only pays off if threads
+// run on more than one host CPU.
+//
+// Release, and re-acquiring inside Condition::Wait, are those of Lock.
+
+class AdaptiveLock : public Lock {
+public:
+    AdaptiveLock(char* debugName);	// initialize lock to be FREE
+
+    void Acquire();		// spin while the owner runs, then block
+    using Lock::Acquire;	// Acquire(ticks) blocks without spinning
+
+    int getSpinLimit() {
+        return spinLimit;	// current self-tuned spin bound
+    }
+    void PrintStats();		// print spin success counts
+
+private:
+    int spinLimit;		// most lock polls to try before blocking
+    int spinWins;		// acquired while spinning
+    int spinLosses;		// spun, then blocked anyway
+    int blockedAtOnce;		// owner not running, blocked without spinning
+};
+
 // The following class defines a "condition variable".  A condition
 // variable does not have a value, but threads may be queued, waiting
 // on the variable.  These are only operations on a condition variable:
 //
 //	Wait() -- release the lock, relinquish the CPU until signaled,
-//		then re-acquire the lock
+//		then re-acquire the lock.  Wait(lock, ticks) stops waiting
+//		for a signal after "ticks" ticks, re-acquires the lock all
+//		the same, and returns FALSE.
 //
 //	Signal() -- wake up a thread, if there are any waiting on
-//		the condition
+//		the condition; returns TRUE if there was one
+//
+//	Broadcast() -- wake up all threads waiting on the condition;
+//		returns how many there were
 //
-//	Broadcast() -- wake up all threads waiting on the condition
+//	HasWaiters() -- is any thread waiting on the condition?  A
+//		waiter that timed out isn't.  Signal and Broadcast
+//		complain when no one is waiting; callers that keep
+//		their own count of waiters, some of which may have timed
+//		out, check this first.
 //
 // All operations on a condition variable must be made while
 // the current thread has acquired a lock.  Indeed, all accesses
@@ -121,6 +349,12 @@ private:
 // The consequence of using Mesa-style semantics is that some other thread
 // can acquire the lock, and change data structures, before the woken
 // thread gets a chance to run.
+//
+// Since the signaller holds the lock, a woken thread could only run
+// as far as blocking again in Acquire.  So Signal and Broadcast use
+// "wait morphing": rather than onto the ready list, they move the
+// woken threads straight onto the lock's wait queue.  Each is made
+// ready only when Release lets it have the lock.
 
 class Condition {
 public:
@@ -135,16 +369,390 @@ public:
     // condition variables; releasing the
     // lock and going to sleep are
     // *atomic* in Wait()
-    void Signal(Lock *conditionLock);   // conditionLock must be held by
-    void Broadcast(Lock *conditionLock);// the currentThread for all of
+    bool Wait(Lock *conditionLock, int ticks);	// Wait, for a signal that
+    // comes within "ticks" ticks
+    bool Signal(Lock *conditionLock);   // conditionLock must be held by
+    int Broadcast(Lock *conditionLock); // the currentThread for all of
     // these operations
+    bool HasWaiters() {
+        return !waitingList->IsEmpty();	// lock must be held, too
+    }
 
 private:
     char* name;
-    List *waitingList;
+    WaitQueue *waitingList;  // threads waiting to be signalled
+    LockStats *profile;      // Wait/Signal statistics, NULL if not kept
     // plus some other stuff you'll need to define
 };
 
+// The following class defines a "reader-writer lock".  Any number of
+// readers may hold the lock at once, or else a single writer.
+//
+//	ReadAcquire() -- wait until no writer holds the lock, then
+//		join the readers
+//
+//	ReadRelease() -- leave the readers; the last one out lets the
+//		waiting writer (or readers) in
+//
+//	WriteAcquire() -- wait until no one holds the lock, then take
+//		it exclusively
+//
+//	WriteRelease() -- give up exclusive hold of the lock
+//
+// Readers and writers wait on separate WaitQueues, highest priority
+// first.  When the lock becomes free, it goes to whichever side has the
+// higher priority waiter: one writer, or every waiting reader.  A new
+// reader may join readers already inside the lock unless a writer of
+// higher priority is waiting -- so a steady stream of readers can keep
+// a writer of equal priority out.
+//
+// Created with "preferWriters" TRUE, a new reader waits whenever any
+// writer is waiting, and a free lock always goes to a waiting writer
+// first, so writers cannot be starved (though readers can be).
+
+class RWLock {
+public:
+    RWLock(char* debugName);		// initialize lock to be FREE
+    RWLock(char* debugName, bool preferWriters);
+    ~RWLock();				// deallocate lock
+    char* getName() {
+        return name;   // debugging assist
+    }
+
+    void ReadAcquire();		// these are the only operations on a lock
+    void ReadRelease();
+    void WriteAcquire();
+    void WriteRelease();
+
+    bool isWriteHeldByCurrentThread();	// true if the current thread
+					// holds this lock for writing
+    int NumReaders() {
+        return readers;		// threads holding the lock to read
+    }
+
+private:
+    char* name;			// for debugging
+    bool preferWriters;		// writers go ahead of readers?
+    int readers;		// threads holding the lock to read
+    Thread *writer;		// thread holding it to write, or NULL
+    bool writerWaking;		// a woken writer has yet to run?
+    WaitQueue *readQueue;	// readers waiting for the lock
+    WaitQueue *writeQueue;	// writers waiting for the lock
+
+    void Setup(char* debugName, bool preferWritersFlag);
+				// shared by the constructors
+    bool ReaderMustWait();	// can't let currentThread in to read?
+    void WakeWaiters();		// hand a free lock to the next waiters
+};
+
+
+// The following class defines a "barrier" for a fixed number of
+// threads.  Each thread calling Wait() blocks until all "count" of them
+// have called it; then they all go on, and the barrier is ready for
+// the next phase.
+//
+//	Wait() -- wait for the rest of this phase's threads; returns TRUE
+//		in exactly one of them (the last to arrive), so that one
+//		"serial" thread can do per-phase work
+//
+// The last thread to arrive wakes the others in one O(n) sweep of the
+// wait queue.  Phases are numbered ("generation"), and a woken thread
+// checks that its phase is over, so a thread racing ahead into the
+// next phase can never be counted in the previous one.
+
+class Barrier {
+public:
+    Barrier(char* debugName, int count);	// "count" threads per phase
+    ~Barrier();				// deallocate the barrier
+    char* getName() {
+        return name;   // debugging assist
+    }
+
+    bool Wait();		// wait for the others; TRUE if we were last
+
+    int getGeneration() {
+        return generation;	// phases completed so far
+    }
+
+private:
+    char* name;			// for debugging
+    int count;			// threads that must arrive each phase
+    int arrived;		// threads that have arrived this phase
+    int generation;		// number of the current phase
+    WaitQueue *queue;		// threads waiting for this phase to end
+};
+
+// The following class defines a "wait group": a count of outstanding
+// children, or other work, that one thread can wait to reach zero.
+//
+//	Add(n) -- n more pieces of work are outstanding
+//	Done() -- one of them has finished
+//	Wait() -- wait until none are outstanding; that is, join all
+//	JoinAny() -- wait until a child forked into the group has
+//		finished, and return the "arg" it was forked with
+//
+// Thread::Fork(func, arg, group) Adds the new thread to "group"; it
+// counts itself Done as it finishes, and is destroyed right away, as
+// a thread no one joins would be.  The waiter is woken once, when the
+// count reaches zero, rather than once per child.
+
+class WaitGroup {
+public:
+    WaitGroup(char* debugName);	// initialize to nothing outstanding
+    ~WaitGroup();		// no one may be waiting
+    char* getName() {
+        return name;   // debugging assist
+    }
+
+    void Add(int n);		// "n" more are outstanding
+    void Done();		// one fewer is
+    void Wait();		// wait until none are
+    int JoinAny();		// wait for a child to finish, return its arg
+
+    int NumOutstanding() {
+        return outstanding;
+    }
+
+private:
+    friend class Thread;
+
+    char* name;			// for debugging
+    int outstanding;		// Add'ed and not yet Done
+    List *finished;		// args of children JoinAny hasn't returned
+    WaitQueue *allDone;		// threads waiting in Wait
+    WaitQueue *anyDone;		// threads waiting in JoinAny
+
+    void Finished(int arg);	// a child forked with "arg" is done
+};
+
+
+// The following class defines a "parking lot" -- one global table of
+// wait queues, shared by every CompactLock and CompactCondition (see
+// below), so that those need not carry a wait queue of their own.
+// Threads "park" on the address of the object they wait for; the
+// table hashes the address to a bucket and finds the queue for it.
+//
+// A queue exists only while some thread is parked on its address:
+// the first Park creates it, and it is freed as soon as the last
+// thread is taken off.  So the memory cost is proportional to the
+// number of waiting threads, not to the number of objects.
+//
+// As with WaitQueue, callers must have interrupts disabled.
+
+class ParkingLot {
+public:
+    ParkingLot();			// initialize to "no one parked"
+    ~ParkingLot();			// de-allocate the table
+
+    void Park(void *address);		// block currentThread on "address"
+    Thread *UnparkOne(void *address);	// wake highest priority thread
+					// parked on "address", if any
+    int UnparkAll(void *address);	// wake every thread on "address"
+    Thread *RequeueOne(void *from, void *to);	// move a thread, still
+					// parked, from one address to another
+    int RequeueAll(void *from, void *to);
+
+    bool HasParked(void *address);	// is anyone parked on "address"?
+    int NumQueues() {
+        return numQueues;		// addresses with threads parked
+    }
+
+private:
+    struct ParkedQueue {		// the threads parked on one address
+        void *address;
+        WaitQueue *queue;
+        ParkedQueue *next;		// next queue in the same bucket
+    };
+
+    ParkedQueue **buckets;		// hash table of parked queues
+    int numQueues;			// queues in the table
+
+    ParkedQueue **Find(void *address);	// where address's queue is, or
+					// would go, in its bucket chain
+    WaitQueue *Lookup(void *address, bool create);
+    void Vacate(void *address);		// free address's queue if empty
+};
+
+// The following classes define a "compact lock" and a "compact
+// condition variable".  They behave like Lock and Condition, always
+// with handoff and wait morphing, but each takes a single machine word and
+// needs no construction beyond setting that word to 0, because their
+// waiters park in the global parkingLot instead of a queue of their own.
+// That makes them cheap enough to give every small object its own lock.
+//
+// A CompactLock's word is its owner's Thread pointer (0 if it is FREE),
+// with the low bit set while threads are parked on the lock.  A
+// CompactCondition's word counts the threads waiting on it, so that
+// Signal and Broadcast can skip the parking lot if there are none.
+// They have no debugging names, and no timed or barging variants.
+
+class CompactLock {
+public:
+    CompactLock();		// initialize lock to be FREE
+    ~CompactLock();		// must be FREE, with no one waiting
+
+    void Acquire();		// these are the only operations on a lock
+    void Release();		// they are both *atomic*
+    bool TryAcquire();		// Acquire, only if the lock is FREE
+
+    bool isHeldByCurrentThread();	// true if the current thread
+					// holds this lock
+
+private:
+    friend class CompactCondition;	// parks its waiters on our address
+
+    unsigned long word;		// owner, | LockParkedBit if waiters
+};
+
+class CompactCondition {
+public:
+    CompactCondition();		// initialize to "no one waiting"
+    ~CompactCondition();	// no one may be waiting
+
+    void Wait(CompactLock *conditionLock);	// these are the 3 operations
+    void Signal(CompactLock *conditionLock);	// on condition variables
+    void Broadcast(CompactLock *conditionLock);
+
+private:
+    int waiters;		// threads parked on this condition
+};
+
+
+// The following classes let one thread wait on several message
+// sources at once -- Mailboxes, Channels and SynchLists -- rather than
+// dedicating a blocked thread to each.
+//
+// A "selectable" is anything a thread can wait to receive from.  It
+// says whether a receive could proceed right now (IsReady), and calls
+// NotifySelectors when it becomes ready.
+//
+// A "select" is a set of selectables.  Wait() returns the index of
+// one that is ready, blocking until there is one.  While it blocks,
+// the Select is registered on every selectable in its set, so the
+// first one to become ready wakes it up; on wakeup it takes itself off
+// all of them again.  Nothing polls.
+//
+// Ready means a receive would not have to wait at the moment Wait
+// returns; another receiver may still get there first, so a thread
+// that must not block should receive with TryReceive or TryRemove.
+// Only one thread at a time may Wait on a Select.
+
+class Select;
+class Selectable;
+
+class SelectEntry {			// a Select's registration on
+public:					// one selectable
+    Select *select;			// who to wake
+    Selectable *source;			// what it is waiting for
+    SelectEntry *prev, *next;		// the source's other registrations
+};
+
+class Selectable {
+public:
+    Selectable();			// no one selecting on it yet
+    virtual ~Selectable();		// no one may be selecting on it
+
+    virtual bool IsReady() = 0;		// could a receive go ahead now?
+
+protected:
+    void NotifySelectors();		// it just became ready; wake
+					// whoever is selecting on it
+
+private:
+    friend class Select;
+    SelectEntry *selectors;		// registered Selects, NULL if none
+};
+
+class Select {
+public:
+    Select(char* debugName);		// initialize to an empty set
+    ~Select();
+
+    int Add(Selectable *source);	// add a source, return its index
+    int Wait();				// wait until a source is ready;
+					// return its index
+    int Wait(int ticks);		// the same, for at most "ticks"
+					// ticks; -1 if none got ready
+    int Poll();				// a ready source, or -1; no waiting
+
+private:
+    friend class Selectable;		// to wake "waiter"
+
+    char* name;				// useful for debugging
+    SelectEntry *entries;		// one per source, by index
+    int numSources;			// sources in the set
+    int maxSources;			// room in "entries"
+    int lastReady;			// index Wait returned last
+    WaitQueue *waiter;			// where the selecting thread sleeps
+
+    int FindReady();			// scan for a ready source
+    int Block(int ticks);		// wait for one, "ticks" < 0 means
+					// forever
+};
+
+// The following classes define a "message buffer" and the "buffer
+// pool" it comes from, for passing large messages without copying
+// them.
+//
+// A pool allocates all of its buffers, of one size, when it is created.
+// Allocate() takes a free buffer (waiting for one, if there are none)
+// and makes the current thread its owner; Free() gives it back.  Only
+// the owner may touch a buffer's data.  Sending a buffer through a
+// Mailbox gives up ownership, and receiving it takes ownership, so a
+// buffer has exactly one owner -- or none, while it is in transit --
+// and the data itself is never copied.
+
+class BufferPool;
+
+class MessageBuffer {
+public:
+    char *getData();		// the payload; only for the owner
+    int getSize() {
+        return size;		// bytes of room in the payload
+    }
+    int getLength() {
+        return length;		// bytes of the payload in use
+    }
+    void setLength(int bytes);	// set bytes in use; only for the owner
+    Thread *getOwner() {
+        return owner;		// NULL if free or in transit
+    }
+
+private:
+    friend class BufferPool;
+    friend class Mailbox;
+
+    char *data;			// "size" bytes, in the pool's storage
+    int size;
+    int length;
+    Thread *owner;		// the only thread that may use it
+    BufferPool *pool;		// where it goes back to
+    MessageBuffer *nextFree;	// next on the pool's free list
+};
+
+class BufferPool {
+public:
+    BufferPool(char* debugName, int count, int bufferSize);
+				// set up "count" free buffers
+    ~BufferPool();		// de-allocate; all must be free
+
+    MessageBuffer *Allocate();	// wait for a free buffer, and own it
+    MessageBuffer *TryAllocate();	// the same, but NULL if none free
+    void Free(MessageBuffer *buffer);	// give an owned buffer back
+
+    int NumFree() {
+        return numFree;
+    }
+
+private:
+    char* name;			// useful for debugging
+    char *storage;		// the data of every buffer
+    MessageBuffer *buffers;	// the buffers
+    int numBuffers;
+    MessageBuffer *freeList;	// buffers no one owns
+    int numFree;		// buffers on "freeList"
+    WaitQueue *waiting;		// threads waiting for a free buffer
+};
 
 // The following class defines a "Mailbox".
 // The Mailbox class will be able to send and receive one word messages
@@ -156,25 +764,105 @@ private:
 //
 // Receive() -- Similarly, Receive waits until Send is called, at which
 //           point the copy is made and both calls return
-class Mailbox{
+//
+// A MessageBuffer can be sent the same way; only the pointer is
+// copied, and ownership of the buffer moves from sender to receiver.
+//
+// A Mailbox is ready, for Select, while a sender is waiting for a
+// receiver.
+class Mailbox : public Selectable {
 public:
     Mailbox();
     ~Mailbox();
 
+    bool IsReady() {
+        return waitingSenders > 0;	// a sender no one has met
+    }
+
     void Send(int message);
     void Receive(int * message);
+    void Send(MessageBuffer *buffer);	// hand an owned buffer over
+    void Receive(MessageBuffer **buffer);	// take over a sent buffer
 
 private:
+    void Deliver(void *item);	// the rendezvous, for either kind
+    void *Collect();		// of message
+
     //char* name;
     Condition *send_msg;
     Condition *receive_msg;
     Lock *mailboxLock;
     List *msg;
-    int senders;
-    int receivers;
+    int senders;		// waiting senders a receiver came for
+    int receivers;		// receivers no sender has come for yet
+    int waitingSenders;		// senders waiting, not yet signalled
 
 };
 
+// The following class defines a "channel": a bounded FIFO buffer of
+// one word messages.  Unlike a Mailbox, a sender doesn't wait for a
+// receiver -- only for room in the buffer -- and a receiver only waits
+// while the buffer is empty.
+//
+// Send() -- wait until there is room, then append a message
+// Receive() -- wait until there is a message, then take the oldest
+// TrySend(), TryReceive() -- the same, but return FALSE rather than
+//		wait
+// SendN() -- send n messages, waiting for room as often as needed
+// ReceiveN() -- wait for at least one message, then take as many as
+//		there are, up to n
+//
+// The messages are kept in a ring buffer, and all of the operations
+// are made atomic by disabling interrupts, as for a Semaphore.
+// Threads are woken only when the buffer goes from empty to not
+// empty (receivers) or from full to not full (senders).  A woken
+// receiver that leaves messages behind wakes the next receiver, and
+// a sender that leaves room wakes the next sender, so every waiter
+// is woken in turn without anyone waking threads on every message.
+//
+// A Channel is ready, for Select, while it holds a message.
+
+class Channel : public Selectable {
+public:
+    Channel(char* debugName, int slots);	// initialize to empty
+    ~Channel();				// de-allocate; no one may wait
+    char* getName() {
+        return name;
+    }
+    bool IsReady() {
+        return count > 0;
+    }
+
+    void Send(int message);		// wait for room, then send
+    void Receive(int *message);		// wait for a message, take it
+    bool TrySend(int message);		// send if there is room
+    bool TryReceive(int *message);	// receive if there is a message
+    void SendN(int *messages, int n);	// send all of "messages"
+    int ReceiveN(int *messages, int n);	// receive 1 to n messages,
+					// return how many
+
+    int NumQueued() {
+        return count;			// messages in the buffer
+    }
+    int getCapacity() {
+        return capacity;
+    }
+
+private:
+    char* name;				// useful for debugging
+    int *buffer;			// the ring buffer of messages
+    int capacity;			// slots in "buffer"
+    int head;				// slot of the oldest message
+    int count;				// messages in the buffer
+    WaitQueue *senders;			// waiting for room
+    WaitQueue *receivers;		// waiting for a message
+
+    void Put(int *messages, int n);	// copy n messages in, waking
+					// receivers if it was empty
+    void Take(int *messages, int n);	// copy n messages out, waking
+					// senders if it was full
+};
+
 
 
 // The following class defines Whiles.
@@ -215,4 +903,68 @@ private:
     int females;
     int matchmakers;
 };
+
+// The following class defines a "rendezvous" -- a generalized Whale.
+// Threads arrive in one of several roles, and wait until a complete
+// group has arrived: "arity[r]" threads of each role r.  Then the whole
+// group returns at once.  If more threads of a role arrive than a group
+// needs, the extra ones wait for the next group, first come first
+// served.
+//
+// Arrive() -- wait until a group including us is complete; return its
+//	match number (0 for the first group, 1 for the next, ...)
+// Arrive(role, value, values) -- the same, but also contribute "value"
+//	to the group and get every member's value back in "values": all
+//	of role 0's, in order of arrival, then role 1's, and so on.
+//
+// Each role keeps a count of the threads waiting in it, and the
+// rendezvous keeps a count of the roles still short of their arity,
+// so an arrival can tell in O(1) whether it completes a group.  The
+// thread that completes a group makes every other member ready in one
+// pass; no one has to reacquire a lock on the way out.
+
+class RendezvousWaiter {		// one thread waiting in a role;
+public:					// lives on the thread's stack
+    Thread *thread;
+    int value;				// what it brings to the group
+    int *values;			// where it wants the group's values
+    int match;				// its group's number, when matched
+    RendezvousWaiter *next;		// next to arrive in the same role
+};
+
+class Rendezvous {
+public:
+    Rendezvous(char* debugName, int roles);	// one of each role
+    Rendezvous(char* debugName, int roles, int *roleArity);
+					// "roleArity[r]" of role r per group
+    ~Rendezvous();			// no one may be waiting
+    char* getName() {
+        return name;
+    }
+
+    int Arrive(int role);		// wait for a group
+    int Arrive(int role, int value, int *values);
+					// and swap values with it
+    int getGroupSize() {
+        return groupSize;		// threads in a group
+    }
+    int getMatches() {
+        return matches;			// groups completed so far
+    }
+
+private:
+    char* name;				// useful for debugging
+    int numRoles;
+    int *arity;				// threads of each role per group
+    int *offset;			// where each role's values start
+    int groupSize;			// sum of "arity"
+    RendezvousWaiter **first;		// waiting threads of each role,
+    RendezvousWaiter **last;		// in order of arrival
+    int *waiting;			// how many of each role are waiting
+    int rolesShort;			// roles with fewer than their arity
+    int matches;			// groups completed so far
+    RendezvousWaiter **group;		// the group being released
+
+    void Setup(char* debugName, int roles, int *roleArity);
+};
 #endif // SYNCH_H
@@ -14,19 +14,40 @@
 
 #include "copyright.h"
 #include "synchlist.h"
+#include "system.h"
 
 //----------------------------------------------------------------------
 // SynchList::SynchList
 //	Allocate and initialize the data structures needed for a
 //	synchronized list, empty to start with.
 //	Elements can now be added to the list.
+//
+//	"maxItems", if given, is the most items the list may hold;
+//		Append waits while it is full.
 //----------------------------------------------------------------------
 
 SynchList::SynchList()
+{
+    Setup(0);
+}
+
+SynchList::SynchList(int maxItems)
+{
+    ASSERT(maxItems > 0);
+    Setup(maxItems);
+}
+
+void
+SynchList::Setup(int maxItems)
 {
     list = new List();
     lock = new Lock("list lock");
     listEmpty = new Condition("list empty cond");
+    listFull = new Condition("list full cond");
+    numItems = 0;
+    capacity = maxItems;
+    removers = 0;
+    appenders = 0;
 }
 
 //----------------------------------------------------------------------
@@ -39,12 +60,52 @@ SynchList::~SynchList()
     delete list;
     delete lock;
     delete listEmpty;
+    delete listFull;
+}
+
+//----------------------------------------------------------------------
+// SynchList::WaitForRoom
+//	Wait until the list has room for another item.  Called with the
+//	lock held.
+//----------------------------------------------------------------------
+
+void
+SynchList::WaitForRoom()
+{
+    while (capacity > 0 && numItems >= capacity) {
+        appenders++;			// Removed counts us off
+        listFull->Wait(lock);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchList::Removed
+//	Account for "n" items taken off the list, and let as many
+//	waiting appenders as there is room for try again.  Called with
+//	the lock held.
+//
+//	Whoever signals a waiter counts it off, so that a waiter that
+//	hasn't run yet is never signalled twice.
+//----------------------------------------------------------------------
+
+void
+SynchList::Removed(int n)
+{
+    numItems -= n;
+    if (n >= appenders && appenders > 0) {
+        listFull->Broadcast(lock);
+        appenders = 0;
+    }
+    for (; n > 0 && appenders > 0; n--, appenders--)
+        listFull->Signal(lock);
 }
 
 //----------------------------------------------------------------------
 // SynchList::Append
-//      Append an "item" to the end of the list.  Wake up anyone
-//	waiting for an element to be appended.
+//      Append an "item" to the end of the list, waiting for room if
+//	the list is full.  Wake up anyone waiting for an element to be
+//	appended, including any Select waiting on this list if it was
+//	empty.
 //
 //	"item" is the thing to put on the list, it can be a pointer to
 //		anything.
@@ -53,9 +114,59 @@ SynchList::~SynchList()
 void
 SynchList::Append(void *item)
 {
+    bool wasEmpty;
+
     lock->Acquire();		// enforce mutual exclusive access to the list
+    WaitForRoom();
+    wasEmpty = list->IsEmpty();
     list->Append(item);
-    listEmpty->Signal(lock);	// wake up a waiter, if any
+    numItems++;
+    if (removers > 0 && listEmpty->HasWaiters()) {
+        listEmpty->Signal(lock);	// wake up a waiter, if any
+        removers--;
+    }
+    if (wasEmpty)
+        NotifySelectors();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SynchList::AppendN
+//      Append "n" items to the end of the list, in order, holding the
+//	lock throughout -- except while waiting for room, if the list
+//	fills up, when other threads' items may come in between.
+//
+//	"items" is an array of the things to put on the list.
+//----------------------------------------------------------------------
+
+void
+SynchList::AppendN(void **items, int n)
+{
+    bool wasEmpty;
+    int added;
+
+    lock->Acquire();
+    while (n > 0) {
+        WaitForRoom();
+        wasEmpty = list->IsEmpty();
+        for (added = 0; added < n
+                && (capacity == 0 || numItems < capacity); added++) {
+            list->Append(items[added]);
+            numItems++;
+        }
+        items += added;
+        n -= added;
+        if (added >= removers && listEmpty->HasWaiters())
+            removers -= listEmpty->Broadcast(lock);	// an item for each
+        else {
+            for (int i = 0; i < added && listEmpty->HasWaiters(); i++) {
+                listEmpty->Signal(lock);
+                removers--;
+            }
+        }
+        if (wasEmpty)
+            NotifySelectors();
+    }
     lock->Release();
 }
 
@@ -73,10 +184,72 @@ SynchList::Remove()
     void *item;
 
     lock->Acquire();			// enforce mutual exclusion
-    while (list->IsEmpty())
+    while (list->IsEmpty()) {
+        removers++;			// Append counts us off
         listEmpty->Wait(lock);		// wait until list isn't empty
+    }
     item = list->Remove();
     ASSERT(item != NULL);
+    Removed(1);
+    lock->Release();
+    return item;
+}
+
+//----------------------------------------------------------------------
+// SynchList::RemoveUpTo
+//      Remove as many items as there are, up to "n", from the
+//	beginning of the list, under one acquisition of the lock.  If
+//	the list is empty, wait for an item for up to "timeout" ticks
+//	(forever if "timeout" < 0; not at all if it is 0).
+// Returns:
+//	How many items were removed into "items" -- 0 if none arrived
+//	in time.
+//----------------------------------------------------------------------
+
+int
+SynchList::RemoveUpTo(void **items, int n, int timeout)
+{
+    int deadline = stats->totalTicks + timeout;
+    int removed = 0;
+
+    lock->Acquire();
+    while (list->IsEmpty()) {
+        if (timeout >= 0 && deadline <= stats->totalTicks)
+            break;			// out of time
+        removers++;			// Append counts us off,
+        if (timeout < 0)		// unless we time out first
+            listEmpty->Wait(lock);
+        else if (!listEmpty->Wait(lock, deadline - stats->totalTicks))
+            removers--;			// no Append woke us
+    }
+    while (removed < n && !list->IsEmpty())
+        items[removed++] = list->Remove();
+    if (removed > 0)
+        Removed(removed);
+    lock->Release();
+    return removed;
+}
+
+//----------------------------------------------------------------------
+// SynchList::TryRemove
+//      Remove an "item" from the beginning of the list, without ever
+//	waiting -- neither for the list to be non-empty, nor for another
+//	thread to finish with the list.  A failed try leaves interrupts
+//	enabled and doesn't queue us anywhere.
+// Returns:
+//	The removed item, or NULL if the list is empty or busy.
+//----------------------------------------------------------------------
+
+void *
+SynchList::TryRemove()
+{
+    void *item;
+
+    if (!lock->TryAcquire())		// someone else is using the list
+        return NULL;
+    item = list->Remove();		// NULL if the list is empty
+    if (item != NULL)
+        Removed(1);
     lock->Release();
     return item;
 }
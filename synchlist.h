@@ -20,16 +20,37 @@
 //	1. Threads trying to remove an item from a list will
 //	wait until the list has an element on it.
 //	2. One thread at a time can access list data structures
+//	3. If the list was given a capacity, threads trying to append
+//	an item wait until there is room for it.
+//
+// AppendN and RemoveUpTo move a batch of items under one acquisition
+// of the lock.  Waiting threads are only signalled if there are any.
+//
+// A SynchList is ready, for Select, while it isn't empty.
 
-class SynchList {
+class SynchList : public Selectable {
 public:
     SynchList();		// initialize a synchronized list
+    SynchList(int maxItems);	// the same, holding at most
+    // "maxItems" items
     ~SynchList();		// de-allocate a synchronized list
 
+    bool IsReady() {
+        return !list->IsEmpty();
+    }
+
     void Append(void *item);	// append item to the end of the list,
     // and wake up any thread waiting in remove
+    void AppendN(void **items, int n);	// append n items, in order
+    // (waiting for room as needed)
     void *Remove();		// remove the first item from the front of
     // the list, waiting if the list is empty
+    void *TryRemove();		// remove the first item, if the list is
+    // free and not empty; otherwise NULL
+    int RemoveUpTo(void **items, int n, int timeout);
+    // remove 1 to n items, waiting up to
+    // "timeout" ticks (< 0: forever) for
+    // the first; return how many
     // apply function to every item in the list
     void Mapcar(VoidFunctionPtr func);
 
@@ -37,6 +58,16 @@ private:
     List *list;			// the unsynchronized list
     Lock *lock;			// enforce mutual exclusive access to the list
     Condition *listEmpty;	// wait in Remove if the list is empty
+    Condition *listFull;	// wait in Append if the list is full
+    int numItems;		// items on the list
+    int capacity;		// most items allowed, 0 if no limit
+    int removers;		// threads waiting in listEmpty, or timed
+				// out of it and not yet running again
+    int appenders;		// threads waiting in listFull
+
+    void Setup(int maxItems);	// shared by the constructors
+    void WaitForRoom();		// wait in listFull while the list is full
+    void Removed(int n);	// n items are gone; signal appenders
 };
 
 #endif // SYNCHLIST_H
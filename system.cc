@@ -7,6 +7,7 @@
 
 #include "copyright.h"
 #include "system.h"
+#include "synch.h"
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -18,6 +19,14 @@ Interrupt *interrupt;			// interrupt status
 Statistics *stats;			// performance metrics
 Timer *timer;				// the hardware timer device,
 // for invoking context switches
+ParkingLot *parkingLot;			// wait queues for compact locks
+// and conditions
+LockProfiler *lockProfiler;		// lock contention statistics,
+// NULL unless profiling
+OffCpuProfiler *offCpuProfiler;		// blocked time by call chain,
+// NULL unless profiling
+static char *offCpuFile = NULL;		// where to write that profile
+StackPool *stackPool;			// freed thread stacks, for reuse
 
 #ifdef FILESYS_NEEDED
 FileSystem  *fileSystem;
@@ -80,6 +89,7 @@ Initialize(int argc, char **argv)
     int argCount;
     char* debugArgs = "";
     bool randomYield = FALSE;
+    bool profileLocks = FALSE;
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;	// single step user program
@@ -107,6 +117,12 @@ Initialize(int argc, char **argv)
             // number generator
             randomYield = TRUE;
             argCount = 2;
+        } else if (!strcmp(*argv, "-lp")) {
+            profileLocks = TRUE;		// lock contention report
+        } else if (!strcmp(*argv, "-op")) {
+            ASSERT(argc > 1);
+            offCpuFile = *(argv + 1);		// off-CPU folded stacks
+            argCount = 2;
         }
 #ifdef USER_PROGRAM
         if (!strcmp(*argv, "-s"))
@@ -133,6 +149,10 @@ Initialize(int argc, char **argv)
     stats = new Statistics();			// collect statistics
     interrupt = new Interrupt;			// start up interrupt handling
     scheduler = new Scheduler();		// initialize the ready queue
+    stackPool = new StackPool(StackPoolSize);	// no stacks freed yet
+    parkingLot = new ParkingLot();		// no one is parked yet
+    lockProfiler = profileLocks ? new LockProfiler() : NULL;
+    offCpuProfiler = (offCpuFile != NULL) ? new OffCpuProfiler() : NULL;
     if (randomYield)				// start the timer (if needed)
         timer = new Timer(TimerInterruptHandler, 0, randomYield);
 
@@ -188,8 +208,20 @@ Cleanup()
     delete synchDisk;
 #endif
 
+    if (lockProfiler != NULL) {		// all the locks are done with
+        lockProfiler->Print();
+        delete lockProfiler;
+        lockProfiler = NULL;
+    }
+    if (offCpuProfiler != NULL) {
+        offCpuProfiler->Print(offCpuFile);
+        delete offCpuProfiler;
+        offCpuProfiler = NULL;
+    }
     delete timer;
+    delete parkingLot;
     delete scheduler;
+    delete stackPool;
     delete interrupt;
 
     Exit(0);
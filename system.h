@@ -29,6 +29,19 @@ extern Interrupt *interrupt;			// interrupt status
 extern Statistics *stats;			// performance metrics
 extern Timer *timer;				// the hardware alarm clock
 
+class ParkingLot;
+extern ParkingLot *parkingLot;			// waiters on compact locks
+						// and conditions
+class LockProfiler;
+extern LockProfiler *lockProfiler;		// lock contention statistics,
+						// NULL unless -lp
+extern OffCpuProfiler *offCpuProfiler;		// where threads block,
+						// NULL unless -op
+extern StackPool *stackPool;			// freed thread stacks
+
+// Most freed thread stacks kept for reuse.
+#define StackPoolSize	64
+
 #ifdef USER_PROGRAM
 #include "machine.h"
 extern Machine* machine;	// user program memory and registers
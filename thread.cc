@@ -21,6 +21,12 @@
 #include "synch.h"
 #include "system.h"
 
+#ifdef __GLIBC__
+#include <stdlib.h>
+#include <execinfo.h>			// backtrace, for the off-CPU profiler
+#include <cxxabi.h>			// to demangle the names it finds
+#endif
+
 #define STACK_FENCEPOST 0xdeadbeef	// this is put at the top of the
 // execution stack, for detecting
 // stack overflows
@@ -40,6 +46,14 @@ Thread::Thread(char* threadName)
     stack = NULL;
     status = JUST_CREATED;
     priority = 0;
+    queueEntry.item = this;
+    timeoutEntry.item = this;
+    timedOut = FALSE;
+    isJoinable = 0;
+    finished = false;
+    joiner = NULL;
+    group = NULL;
+    forkArg = 0;
 #ifdef USER_PROGRAM
     space = NULL;
 #endif
@@ -57,19 +71,20 @@ Thread::Thread(char* threadName)
 Thread::Thread(char* debugName, int join) {
        name = debugName;
        
-       // joinLock = new Lock("joinLock");
-       // joinCondition = new Condition("joinCondition");
         stackTop = NULL;
         stack = NULL;
-        isjoinCalled = false;
+        status = JUST_CREATED;
+        priority = 0;
+        queueEntry.item = this;
+        timeoutEntry.item = this;
+        timedOut = FALSE;
         if (join > 1 ) join = 1; 
         isJoinable = join;
 
-        joinCond = new Condition("join");
-        joinLock = new Lock("join lock");
-        joinCallCond = new Condition("isjoinCalled");
-       // JoinCalledLock = new Lock("is_join_call_lock");
         finished = false;
+        joiner = NULL;
+        group = NULL;
+        forkArg = 0;
 
     #ifdef USER_PROGRAM
         space = NULL;
@@ -99,52 +114,58 @@ Thread::~Thread()
 
     ASSERT(this != currentThread);
     if (stack != NULL)
-        DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
-
-    if (joinCond != NULL)
-        delete joinCond;
-    if (joinLock != NULL)
-        delete joinLock;
-    if (joinCallCond != NULL)
-        delete joinCallCond;
-//  if(JoinCalledLock != NULL)
-//      delete JoinCalledLock;
+        stackPool->Free(stack);
 }
 /*********************************************************************
 Thread:: Join
  Join is function that stops the parent thread and run the child thread.
  the one that calls Join is the parent thread. 
+
+ A child that has already finished is a zombie: its stack is gone, and
+ only the thread record is left, for Join to find and delete; so the
+ parent doesn't block.  Otherwise the parent sleeps until the child's
+ Finish wakes it.  Either way the child is gone once Join returns, so
+ the thread may not be used -- or joined again -- after that.
 *********************************************************************/
 
 void 
 Thread::Join(){
+    IntStatus oldLevel;
 
     ASSERT(this->getIsJoinable() != 0);
     ASSERT(status != JUST_CREATED);
     ASSERT(this != currentThread);
     ASSERT(this != NULL);
+    ASSERT(joiner == NULL);		// only one parent may Join
 
-
-    // if child is finish 
-    //  do nothing  
-    joinLock->Acquire();
-    if(this->getFinished() == true) {
-        ;
-    }
-    // if this(child) is not finish 
-    // make the parent (currentThread) wait;
-    // wait for signal
-    else {
-        joinCond->Wait(joinLock);
+    oldLevel = interrupt->SetLevel(IntOff);
+    while (!finished) {
+        joiner = currentThread;		// Finish wakes us
+        currentThread->Sleep();
     }
-    isjoinCalled = true;
-    joinCallCond->Signal(joinLock);
-    joinLock->Release();
+    (void) interrupt->SetLevel(oldLevel);
 
+    ASSERT(status == ZOMBIE);
+    delete this;
 }
 
+//----------------------------------------------------------------------
+// Thread::BecomeZombie
+// 	Free the stack of a joinable thread that has finished, leaving
+//	just the thread record for Join.  Called by Scheduler::Run, once
+//	we are off the thread's stack, instead of deleting the thread.
+//----------------------------------------------------------------------
 
-
+void
+Thread::BecomeZombie()
+{
+    ASSERT(finished && this != currentThread);
+    if (stack != NULL) {
+        stackPool->Free(stack);
+        stack = NULL;
+    }
+    status = ZOMBIE;
+}
 
 //----------------------------------------------------------------------
 // Thread::Fork
@@ -173,14 +194,35 @@ Thread::Fork(VoidFunctionPtr func, int arg)
     DEBUG('t', "Forking thread \"%s\" with func = 0x%x, arg = %d\n",
           name, (int) func, arg);
 
-    StackAllocate(func, arg);
-
     IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    StackAllocate(func, arg);		// takes from the stack pool, which
+    // is shared with Scheduler::Run
     scheduler->ReadyToRun(this);	// ReadyToRun assumes that interrupts
     // are disabled!
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Thread::Fork
+// 	Fork the thread as a child counted in "waitGroup": it is Added to
+//	the group now, and counted Done when it finishes.  The thread
+//	must not be joinable; the group takes the place of Join, and the
+//	thread is destroyed as soon as it finishes.
+//
+//	"func", "arg" are as for the other Fork.
+//	"waitGroup" is the WaitGroup to count the thread in.
+//----------------------------------------------------------------------
+
+void
+Thread::Fork(VoidFunctionPtr func, int arg, WaitGroup *waitGroup)
+{
+    ASSERT(isJoinable == 0);
+    waitGroup->Add(1);
+    group = waitGroup;
+    forkArg = arg;
+    Fork(func, arg);
+}
+
 //----------------------------------------------------------------------
 // Thread::CheckOverflow
 // 	Check a thread's stack to see if it has overrun the space
@@ -214,50 +256,35 @@ Thread::CheckOverflow()
 // 	NOTE: we don't immediately de-allocate the thread data structure
 //	or the execution stack, because we're still running in the thread
 //	and we're still on the stack!  Instead, we set "threadToBeDestroyed",
-//	so that Scheduler::Run() will call the destructor, once we're
-//	running in the context of a different thread.
+//	so that Scheduler::Run() will put us on its list of dead threads,
+//	to be deleted in a batch, once we're running in the context of a
+//	different thread.  If the thread is joinable, Scheduler::Run()
+//	only frees its stack, and Join deletes the rest.
+//
+//	A thread forked into a WaitGroup counts itself Done there first.
 //
 // 	NOTE: we disable interrupts, so that we don't get a time slice
 //	between setting threadToBeDestroyed, and going to sleep.
 //----------------------------------------------------------------------
 
-//
 void
 Thread::Finish ()
-{   
-    if (isJoinable == 0) {
-
-        (void) interrupt->SetLevel(IntOff);
-        ASSERT(this == currentThread);
-
-        DEBUG('t', "Finishing thread \"%s\"\n", getName());
-
-        threadToBeDestroyed = currentThread;
-        Sleep();					// invokes SWITCH
-    // not reached
-    }
-    else {
-       // JoinCalledLock->Acquire();
-        joinLock->Acquire();
-        ASSERT(this == currentThread);
-
-        DEBUG('t', "Finishing thread \"%s\"\n", getName());
-
-        finished = true;
-        joinCond->Signal(joinLock);
-       
-        // this one use to protect the parenet thread.
-        while(!isjoinCalled){
-             joinCallCond->Wait(joinLock);
-        }
+{
+    (void) interrupt->SetLevel(IntOff);
+    ASSERT(this == currentThread);
 
-        joinLock->Release();
-        isjoinCalled = false;
+    DEBUG('t', "Finishing thread \"%s\"\n", getName());
 
-        (void) interrupt->SetLevel(IntOff);
-        threadToBeDestroyed = currentThread;
-        Sleep();   
+    if (group != NULL)
+        group->Finished(forkArg);	// may wake the parent
+    finished = TRUE;
+    if (joiner != NULL) {		// the parent is waiting in Join
+        scheduler->ReadyToRun(joiner);
+        joiner = NULL;
     }
+    threadToBeDestroyed = currentThread;
+    Sleep();					// invokes SWITCH
+    // not reached
 }
 
 //----------------------------------------------------------------------
@@ -288,22 +315,44 @@ Thread::Yield ()
 
     DEBUG('t', "Yielding thread \"%s\"\n", getName());
 
-    nextThread = scheduler->FindNextToRun();
-        /* Yield would grab the next thread to run from the readylist, 
-    compare its priority with the current thread and then either run 
-    this thread if it has higher or equal priority, otherwise put it 
-    back on the ready list. -- essentially a no-op.*/
+    nextThread = scheduler->PeekNextToRun();
+        /* Yield would look at the next thread to run on the readylist, 
+    compare its priority with the current thread and then either keep 
+    running this thread if it has higher priority, otherwise put this 
+    thread back on the ready list and run the other one.  (We must not 
+    put ourselves on the ready list while we keep running -- a thread 
+    can only be on one queue at a time.) */
 
-    if (nextThread != NULL) {
+    if (nextThread != NULL && priority <= nextThread->getPriority()) {
+        nextThread = scheduler->FindNextToRun();
         scheduler->ReadyToRun(this);
-        if (currentThread->getPriority() > nextThread->getPriority())
-            scheduler->Run(currentThread);
-        else
-            scheduler->Run(nextThread);
+        scheduler->Run(nextThread);
     }
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Thread::setPriority
+// 	Change the thread's priority.  If the thread is waiting on a
+//	queue -- the ready list, or the wait queue of a Semaphore, Lock
+//	or Condition -- it is moved to its new place right away, in
+//	O(log n), rather than at the next time it is re-queued.
+//
+//	"newPriority" is the new priority; larger runs first.
+//----------------------------------------------------------------------
+
+void
+Thread::setPriority(int newPriority)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    priority = newPriority;
+    if (queueEntry.heap != NULL)
+        queueEntry.heap->ChangeKey(&queueEntry, priority * (-1));
+
+    (void) interrupt->SetLevel(oldLevel);
+}
+
 //----------------------------------------------------------------------
 // Thread::Sleep
 // 	Relinquish the CPU, because the current thread is blocked
@@ -327,6 +376,9 @@ void
 Thread::Sleep ()
 {
     Thread *nextThread;
+    OffCpuProfiler *profiler = offCpuProfiler;
+    OffCpuStack *where = NULL;
+    int blockedAt = 0;
 
     ASSERT(this == currentThread);
     ASSERT(interrupt->getLevel() == IntOff);
@@ -334,24 +386,38 @@ Thread::Sleep ()
     DEBUG('t', "Sleeping thread \"%s\"\n", getName());
 
     status = BLOCKED;
-    while ((nextThread = scheduler->FindNextToRun()) == NULL)
+    if (profiler != NULL) {		// note who blocked, and from where
+        where = profiler->Capture();
+        blockedAt = stats->totalTicks;
+    }
+    while ((nextThread = scheduler->FindNextToRun()) == NULL) {
+        scheduler->Reap();	// nothing better to do
         interrupt->Idle();	// no one to run, wait for an interrupt
+    }
 
     scheduler->Run(nextThread); // returns when we've been signalled
+
+    if (where != NULL)		// we're dispatched again
+        profiler->NoteBlocked(where, stats->totalTicks - blockedAt);
 }
 
 //----------------------------------------------------------------------
-// ThreadFinish, InterruptEnable, ThreadPrint
+// ThreadFinish, ThreadBegin, ThreadPrint
 //	Dummy functions because C++ does not allow a pointer to a member
 //	function.  So in order to do this, we create a dummy C function
 //	(which we can pass a pointer to), that then simply calls the
 //	member function.
+//
+//	ThreadBegin is the first thing a new thread runs.  It hasn't
+//	returned from Scheduler::Run, so it must dispose of the thread
+//	that finished to let it run, as Scheduler::Run would have.
 //----------------------------------------------------------------------
 
 static void ThreadFinish()    {
     currentThread->Finish();
 }
-static void InterruptEnable() {
+static void ThreadBegin() {
+    scheduler->CheckToBeDestroyed();
     interrupt->Enable();
 }
 void ThreadPrint(int arg) {
@@ -374,7 +440,9 @@ void ThreadPrint(int arg) {
 void
 Thread::StackAllocate (VoidFunctionPtr func, int arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    if (stackPool->NumFree() == 0)
+        scheduler->Reap();	// dead threads' stacks will do
+    stack = stackPool->Allocate();
 
 #ifdef HOST_SNAKE
     // HP stack works from low addresses to high addresses
@@ -399,12 +467,900 @@ Thread::StackAllocate (VoidFunctionPtr func, int arg)
 #endif  // HOST_SNAKE
 
     machineState[PCState] = (int) ThreadRoot;
-    machineState[StartupPCState] = (int) InterruptEnable;
+    machineState[StartupPCState] = (int) ThreadBegin;
     machineState[InitialPCState] = (int) func;
     machineState[InitialArgState] = arg;
     machineState[WhenDonePCState] = (int) ThreadFinish;
 }
 
+// Number of buckets in the off-CPU profiler's table of call chains.
+#define OffCpuBuckets	61
+
+//----------------------------------------------------------------------
+// StackPool::StackPool
+// 	Initialize an empty pool, to keep up to "stackSize" stacks.
+//----------------------------------------------------------------------
+
+StackPool::StackPool(int stackSize)
+{
+    size = stackSize;
+    stacks = new int *[size];
+    numFree = allocated = reused = 0;
+}
+
+//----------------------------------------------------------------------
+// StackPool::~StackPool
+// 	Give every pooled stack back to the host, and de-allocate the pool.
+//----------------------------------------------------------------------
+
+StackPool::~StackPool()
+{
+    while (numFree > 0)
+        DeallocBoundedArray((char *) stacks[--numFree],
+                            StackSize * sizeof(int));
+    delete [] stacks;
+}
+
+//----------------------------------------------------------------------
+// StackPool::Allocate
+// 	Return a stack of StackSize words: a pooled one if there is one,
+//	or else a new one from the host.
+//----------------------------------------------------------------------
+
+int *
+StackPool::Allocate()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    int *stack;
+
+    if (numFree > 0) {
+        stack = stacks[--numFree];
+        reused++;
+    } else {
+        stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+        allocated++;
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    return stack;
+}
+
+//----------------------------------------------------------------------
+// StackPool::Free
+// 	Keep a stack that is no longer in use for reuse, or, if the pool
+//	is full, give it back to the host.
+//----------------------------------------------------------------------
+
+void
+StackPool::Free(int *stack)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+
+    if (numFree < size)
+        stacks[numFree++] = stack;
+    else
+        DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// OffCpuProfiler::OffCpuProfiler
+// 	Initialize the profiler, with no call chains yet.
+//
+//	The first backtrace() loads the unwinder, which takes more stack
+//	than a thread has, so get that over with here, on the main stack.
+//----------------------------------------------------------------------
+
+OffCpuProfiler::OffCpuProfiler()
+{
+    buckets = new OffCpuStack *[OffCpuBuckets];
+    for (int i = 0; i < OffCpuBuckets; i++)
+        buckets[i] = NULL;
+    numStacks = 0;
+
+#ifdef __GLIBC__
+    void *frame;
+    (void) backtrace(&frame, 1);
+#endif
+}
+
+OffCpuProfiler::~OffCpuProfiler()
+{
+    OffCpuStack *chain, *next;
+
+    for (int i = 0; i < OffCpuBuckets; i++) {
+        for (chain = buckets[i]; chain != NULL; chain = next) {
+            next = chain->next;
+            delete chain;
+        }
+    }
+    delete [] buckets;
+}
+
+//----------------------------------------------------------------------
+// OffCpuProfiler::Capture
+// 	Return the record for the current call chain, from our caller
+//	(Thread::Sleep) outward, adding it if it is new.
+//
+//	Without backtrace(), every thread blocks in the same empty chain.
+//----------------------------------------------------------------------
+
+OffCpuStack *
+OffCpuProfiler::Capture()
+{
+    void *frames[OffCpuMaxDepth + 1];
+    int depth = 0;
+    unsigned hash = 0;
+    OffCpuStack *chain;
+
+#ifdef __GLIBC__
+    depth = backtrace(frames, OffCpuMaxDepth + 1) - 1;	// less this frame
+    if (depth < 0)
+        depth = 0;
+#endif
+    for (int i = 0; i < depth; i++)
+        hash = hash * 31 + (unsigned) (unsigned long) frames[i + 1];
+
+    for (chain = buckets[hash % OffCpuBuckets]; chain != NULL;
+            chain = chain->next) {
+        if (chain->hash != hash || chain->depth != depth)
+            continue;
+        int i;
+        for (i = 0; i < depth && chain->frames[i] == frames[i + 1]; i++)
+            ;
+        if (i == depth)
+            return chain;
+    }
+
+    chain = new OffCpuStack;
+    for (int i = 0; i < depth; i++)
+        chain->frames[i] = frames[i + 1];
+    chain->depth = depth;
+    chain->hash = hash;
+    chain->blocked = 0;
+    chain->count = 0;
+    chain->next = buckets[hash % OffCpuBuckets];
+    buckets[hash % OffCpuBuckets] = chain;
+    numStacks++;
+    return chain;
+}
+
+//----------------------------------------------------------------------
+// OffCpuProfiler::NoteBlocked
+// 	Charge "ticks" spent blocked to the call chain "where".
+//----------------------------------------------------------------------
+
+void
+OffCpuProfiler::NoteBlocked(OffCpuStack *where, int ticks)
+{
+    where->blocked += ticks;
+    where->count++;
+}
+
+//----------------------------------------------------------------------
+// OffCpuProfiler::Print
+// 	Write every call chain that spent time blocked as a line of
+//	folded stacks: the frames, outermost first and separated by
+//	semicolons, then a space and the blocked ticks.
+//
+//	Frames are named by function, with the arguments dropped, when
+//	the symbol can be found, and by address when it can't.
+//
+//	"fileName" is the file to write, or NULL for stdout.
+//----------------------------------------------------------------------
+
+void
+OffCpuProfiler::Print(char *fileName)
+{
+    FILE *out = stdout;
+    OffCpuStack *chain;
+
+    if (fileName != NULL && (out = fopen(fileName, "w")) == NULL) {
+        printf("Can't write the off-CPU profile to %s\n", fileName);
+        return;
+    }
+
+    for (int b = 0; b < OffCpuBuckets; b++) {
+        for (chain = buckets[b]; chain != NULL; chain = chain->next) {
+            if (chain->blocked == 0)
+                continue;
+            char **symbols = NULL;
+#ifdef __GLIBC__
+            symbols = backtrace_symbols(chain->frames, chain->depth);
+#endif
+            for (int i = chain->depth - 1; i >= 0; i--) {
+                char *name = NULL, *demangled = NULL;
+                int status;
+
+                // backtrace_symbols gives "file(symbol+offset) [address]"
+                if (symbols != NULL) {
+                    char *start = strchr(symbols[i], '(');
+                    char *end = (start == NULL) ? NULL
+                                                : strchr(start, '+');
+                    if (end != NULL && end > start + 1) {
+                        name = start + 1;
+                        *end = '\0';
+                    }
+                }
+#ifdef __GLIBC__
+                if (name != NULL)
+                    demangled = abi::__cxa_demangle(name, NULL, NULL,
+                                                    &status);
+#endif
+                if (demangled != NULL) {
+                    char *args = strchr(demangled, '(');
+                    if (args != NULL)
+                        *args = '\0';
+                    name = demangled;
+                }
+                if (name != NULL)
+                    fprintf(out, "%s", name);
+                else
+                    fprintf(out, "%p", chain->frames[i]);
+                if (i > 0)
+                    fprintf(out, ";");
+#ifdef __GLIBC__
+                free(demangled);
+#endif
+            }
+            if (chain->depth == 0)
+                fprintf(out, "[unknown]");
+            fprintf(out, " %d\n", chain->blocked);
+#ifdef __GLIBC__
+            free(symbols);
+#endif
+        }
+    }
+
+    if (out != stdout)
+        fclose(out);
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::ThreadPool
+// 	Initialize a pool of worker threads, with no work queued, and
+//	start the minimum number of workers.
+//
+//	"debugName" is an arbitrary name, useful for debugging; the
+//		workers are named after the pool.
+//	"initialWorkers" is the size of a fixed pool.
+//	"fewest", "most" bound the size of an elastic pool.
+//	"timeout" is how many ticks a worker beyond the minimum
+//		waits for work before exiting; 0 means they never do.
+//----------------------------------------------------------------------
+
+ThreadPool::ThreadPool(char* debugName, int initialWorkers)
+{
+    Setup(debugName, initialWorkers, initialWorkers, 0);
+}
+
+ThreadPool::ThreadPool(char* debugName, int fewest, int most, int timeout)
+{
+    Setup(debugName, fewest, most, timeout);
+}
+
+void
+ThreadPool::Setup(char* debugName, int fewest, int most, int timeout)
+{
+    ASSERT(0 <= fewest && fewest <= most && most > 0);
+    name = debugName;
+    minWorkers = fewest;
+    maxWorkers = most;
+    idleTimeout = timeout;
+    numWorkers = idleWorkers = workersStarted = 0;
+    stopping = FALSE;
+    first = last = freeTasks = NULL;
+    lock = new Lock(debugName);
+    workQueued = new Condition(debugName);
+    workDone = new Condition(debugName);
+    workersGone = new Condition(debugName);
+
+    lock->Acquire();
+    for (int i = 0; i < minWorkers; i++)
+        StartWorker();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::~ThreadPool
+// 	Let the workers run whatever work is still queued, wait for
+//	them all to exit, then de-allocate the pool.  Every handle must
+//	have been joined.
+//----------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+    PoolTask *task;
+
+    lock->Acquire();
+    stopping = TRUE;
+    // Wake the idle workers: there is nothing to wait for any more.
+    // Any that timed out count themselves off.
+    if (workQueued->HasWaiters())
+        idleWorkers -= workQueued->Broadcast(lock);
+    while (numWorkers > 0)
+        workersGone->Wait(lock);
+    lock->Release();
+
+    while ((task = freeTasks) != NULL) {
+        freeTasks = task->next;
+        delete task;
+    }
+    delete workersGone;
+    delete workDone;
+    delete workQueued;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Submit, ThreadPool::Execute
+// 	Queue (*func)(arg) to be run by a worker.  Submit returns a
+//	handle, which must be joined; Execute doesn't.
+//----------------------------------------------------------------------
+
+PoolTask *
+ThreadPool::Submit(VoidFunctionPtr func, int arg)
+{
+    return Queue(func, arg, FALSE);
+}
+
+void
+ThreadPool::Execute(VoidFunctionPtr func, int arg)
+{
+    (void) Queue(func, arg, TRUE);
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Queue
+// 	Append (*func)(arg) to the queue of work, in a recycled handle
+//	if there is one.  Wake an idle worker for it, or if none is
+//	idle, start another worker if the pool may grow.
+//----------------------------------------------------------------------
+
+PoolTask *
+ThreadPool::Queue(VoidFunctionPtr func, int arg, bool detached)
+{
+    PoolTask *task;
+
+    lock->Acquire();
+    ASSERT(!stopping);
+    if (freeTasks != NULL) {
+        task = freeTasks;
+        freeTasks = task->next;
+    } else {
+        task = new PoolTask;
+    }
+    task->func = func;
+    task->arg = arg;
+    task->done = FALSE;
+    task->detached = detached;
+    task->joining = FALSE;
+    task->pool = this;
+    task->next = NULL;
+    if (last == NULL)
+        first = task;
+    else
+        last->next = task;
+    last = task;
+
+    if (idleWorkers > 0) {
+        // Count off only a worker we woke.  If the idle ones have all
+        // timed out, the first of them to run takes this task.
+        if (workQueued->HasWaiters()) {
+            workQueued->Signal(lock);
+            idleWorkers--;
+        }
+    } else if (numWorkers < maxWorkers) {
+        StartWorker();
+    }
+    lock->Release();
+    return task;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::StartWorker
+// 	Fork another worker.  Called with the lock held.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::StartWorker()
+{
+    Thread *t = new Thread(name);
+
+    numWorkers++;
+    workersStarted++;
+    t->Fork(WorkerRoot, (int) this);
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Recycle
+// 	Put a handle whose work is done on the free list.  Called with
+//	the lock held.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::Recycle(PoolTask *task)
+{
+    task->next = freeTasks;
+    freeTasks = task;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::WorkerRoot
+// 	Dummy function because C++ does not allow a pointer to a member
+//	function: the procedure each worker is forked to run.
+//
+//	"pool" is the ThreadPool the worker belongs to.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::WorkerRoot(int pool)
+{
+    ((ThreadPool *) pool)->Work();
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Work
+// 	A worker's life: take work off the queue and run it, without
+//	the lock held, until the pool is stopping and the queue is
+//	empty.  A worker beyond the minimum that waits "idleTimeout"
+//	ticks without getting any work exits early.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::Work()
+{
+    PoolTask *task;
+    bool retiring = FALSE;
+
+    lock->Acquire();
+    for (;;) {
+        while (first == NULL && !stopping && !retiring) {
+            idleWorkers++;			// Queue counts us off if
+            if (idleTimeout > 0 && numWorkers > minWorkers) {
+                if (!workQueued->Wait(lock, idleTimeout)) {
+                    idleWorkers--;		// it wakes us; it didn't
+                    retiring = (first == NULL && numWorkers > minWorkers);
+                }
+            } else {
+                workQueued->Wait(lock);
+            }
+        }
+        if (first == NULL)
+            break;				// stopping, or retiring
+
+        task = first;
+        first = task->next;
+        if (first == NULL)
+            last = NULL;
+        lock->Release();
+        (*task->func)(task->arg);
+        lock->Acquire();
+
+        task->done = TRUE;
+        if (task->detached)
+            Recycle(task);
+        else if (task->joining)
+            workDone->Broadcast(lock);
+    }
+
+    numWorkers--;
+    if (stopping && numWorkers == 0)
+        workersGone->Signal(lock);	// the destructor is waiting
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// PoolTask::Join
+// 	Wait until the work has been done, then give the handle back to
+//	the pool.  The handle may not be used afterwards.
+//----------------------------------------------------------------------
+
+void
+PoolTask::Join()
+{
+    ThreadPool *owner = pool;
+
+    ASSERT(!detached);
+    owner->lock->Acquire();
+    while (!done) {
+        joining = TRUE;
+        owner->workDone->Wait(owner->lock);
+    }
+    owner->Recycle(this);
+    owner->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// TaskDeque::TaskDeque
+// 	Initialize an empty deque of tasks.
+//----------------------------------------------------------------------
+
+TaskDeque::TaskDeque()
+{
+    capacity = 16;
+    tasks = new Task *[capacity];
+    top = bottom = 0;
+}
+
+//----------------------------------------------------------------------
+// TaskDeque::~TaskDeque
+// 	De-allocate a deque, which must be empty.
+//----------------------------------------------------------------------
+
+TaskDeque::~TaskDeque()
+{
+    ASSERT(IsEmpty());
+    delete [] tasks;
+}
+
+//----------------------------------------------------------------------
+// TaskDeque::Push
+// 	Put a task at the bottom of the deque, doubling the array if it
+//	is full.  Called with interrupts off, as are Pop and Steal.
+//----------------------------------------------------------------------
+
+void
+TaskDeque::Push(Task *task)
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+    if (bottom - top == capacity) {
+        Task **grown = new Task *[2 * capacity];
+
+        for (int i = top; i < bottom; i++)
+            grown[i & (2 * capacity - 1)] = tasks[i & (capacity - 1)];
+        delete [] tasks;
+        tasks = grown;
+        capacity *= 2;
+    }
+    tasks[bottom & (capacity - 1)] = task;
+    bottom++;
+}
+
+//----------------------------------------------------------------------
+// TaskDeque::Pop
+// 	Take the newest task off the bottom of the deque, or return NULL
+//	if it is empty.
+//----------------------------------------------------------------------
+
+Task *
+TaskDeque::Pop()
+{
+    ASSERT(interrupt->getLevel() == IntOff);
+    if (IsEmpty())
+        return NULL;
+    bottom--;
+    return tasks[bottom & (capacity - 1)];
+}
+
+//----------------------------------------------------------------------
+// TaskDeque::Steal
+// 	Take the oldest task off the top of the deque, or return NULL
+//	if it is empty.
+//----------------------------------------------------------------------
+
+Task *
+TaskDeque::Steal()
+{
+    Task *task;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+    if (IsEmpty())
+        return NULL;
+    task = tasks[top & (capacity - 1)];
+    top++;
+    if (IsEmpty())
+        top = bottom = 0;		// so the indices never overflow
+    return task;
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::TaskRuntime
+// 	Initialize a task runtime, and fork its worker threads, which
+//	sleep until there is work to do.
+//
+//	"debugName" is an arbitrary name, useful for debugging; the
+//		workers are named after the runtime.
+//	"count" is how many worker threads to fork.
+//----------------------------------------------------------------------
+
+TaskRuntime::TaskRuntime(char* debugName, int count)
+{
+    ASSERT(count > 0);
+    name = debugName;
+    numWorkers = count;
+    idleWorkers = 0;
+    stopping = FALSE;
+    idle = new WaitQueue(debugName);
+    workersGone = new Semaphore(debugName, 0);
+    freeTasks = NULL;
+    spawned = steals = 0;
+
+    workers = new TaskWorker[numWorkers];
+    for (int i = 0; i < numWorkers; i++) {
+        workers[i].thread = new Thread(debugName);
+        workers[i].deque = new TaskDeque();
+        workers[i].current = NULL;
+        workers[i].victim = (i + 1) % numWorkers;
+        workers[i].runtime = this;
+    }
+    for (int i = 0; i < numWorkers; i++)
+        workers[i].thread->Fork(WorkerRoot, (int) &workers[i]);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::~TaskRuntime
+// 	Tell the workers to exit, wait until they have, then de-allocate
+//	the runtime.  No task may be running.
+//----------------------------------------------------------------------
+
+TaskRuntime::~TaskRuntime()
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Task *task;
+
+    stopping = TRUE;
+    idleWorkers = 0;
+    (void) idle->WakeAll();
+    (void) interrupt->SetLevel(oldLevel);
+
+    for (int i = 0; i < numWorkers; i++)
+        workersGone->P();
+    for (int i = 0; i < numWorkers; i++)
+        delete workers[i].deque;
+    delete [] workers;
+    while ((task = freeTasks) != NULL) {
+        freeTasks = task->next;
+        delete task;
+    }
+    delete workersGone;
+    delete idle;
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::Run
+// 	Run (*func)(arg) as a task, and wait until it and all of its
+//	descendants have finished.  Called by a thread that isn't one of
+//	the workers; several threads may Run tasks at the same time.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::Run(VoidFunctionPtr func, int arg)
+{
+    Task caller;		// stands in for the parent of the task
+    IntStatus oldLevel;
+
+    ASSERT(CurrentWorker() == NULL);
+    caller.pending = 1;
+    caller.syncer = NULL;
+    oldLevel = interrupt->SetLevel(IntOff);
+    Push(workers[0].deque, NewTask(func, arg, &caller));
+    (void) interrupt->SetLevel(oldLevel);
+    WaitFor(NULL, &caller);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::Spawn
+// 	Start (*func)(arg) as a child of the task that is running.  It
+//	goes on the bottom of this worker's deque, so unless another
+//	worker steals it, this worker will run it when it next Syncs.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::Spawn(VoidFunctionPtr func, int arg)
+{
+    TaskWorker *worker = CurrentWorker();
+    IntStatus oldLevel;
+
+    ASSERT(worker != NULL && worker->current != NULL);	// only a task
+    oldLevel = interrupt->SetLevel(IntOff);
+    worker->current->pending++;
+    Push(worker->deque, NewTask(func, arg, worker->current));
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::Sync
+// 	Wait until every child of the task that is running has finished.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::Sync()
+{
+    TaskWorker *worker = CurrentWorker();
+
+    ASSERT(worker != NULL && worker->current != NULL);	// only a task
+    WaitFor(worker, worker->current);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::CurrentWorker
+// 	Return the record of the worker that currentThread is, or NULL
+//	if it isn't one of ours.
+//----------------------------------------------------------------------
+
+TaskWorker *
+TaskRuntime::CurrentWorker()
+{
+    for (int i = 0; i < numWorkers; i++)
+        if (workers[i].thread == currentThread)
+            return &workers[i];
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::NewTask
+// 	Return a task to run (*func)(arg), with no children yet, reusing
+//	a finished one if there is one.  Called with interrupts off.
+//----------------------------------------------------------------------
+
+Task *
+TaskRuntime::NewTask(VoidFunctionPtr func, int arg, Task *parent)
+{
+    Task *task = freeTasks;
+
+    if (task != NULL)
+        freeTasks = task->next;
+    else
+        task = new Task;
+    task->func = func;
+    task->arg = arg;
+    task->parent = parent;
+    task->pending = 0;
+    task->syncer = NULL;
+    task->next = NULL;
+    return task;
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::Push
+// 	Put a new task on a deque, and wake an idle worker, if there is
+//	one, to steal it.  Called with interrupts off.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::Push(TaskDeque *deque, Task *task)
+{
+    deque->Push(task);
+    spawned++;
+    if (idleWorkers > 0) {		// whoever wakes counts off
+        idleWorkers--;
+        (void) idle->WakeOne();
+    }
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::FindWork
+// 	Return a task for "worker" to run: the newest on its own deque,
+//	or failing that the oldest on someone else's, trying each in
+//	turn; or NULL if there is none.  Called with interrupts off.
+//----------------------------------------------------------------------
+
+Task *
+TaskRuntime::FindWork(TaskWorker *worker)
+{
+    Task *task = worker->deque->Pop();
+    TaskWorker *victim;
+
+    for (int i = 0; task == NULL && i < numWorkers; i++) {
+        victim = &workers[worker->victim];
+        worker->victim = (worker->victim + 1) % numWorkers;
+        if (victim == worker)
+            continue;
+        task = victim->deque->Steal();
+        if (task != NULL) {
+            steals++;
+            DEBUG('t', "%s stole a task from %s\n", worker->thread->getName(),
+                  victim->thread->getName());
+        }
+    }
+    return task;
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::RunTask
+// 	Run a task on "worker", wait for its children (the implicit Sync
+//	at the end of every task), then tell its parent it has finished,
+//	waking the parent's worker if it is waiting for that.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::RunTask(TaskWorker *worker, Task *task)
+{
+    Task *outer = worker->current;
+    Task *parent = task->parent;
+    IntStatus oldLevel;
+
+    worker->current = task;
+    (*task->func)(task->arg);
+    WaitFor(worker, task);
+    worker->current = outer;
+
+    oldLevel = interrupt->SetLevel(IntOff);
+    parent->pending--;
+    if (parent->pending == 0 && parent->syncer != NULL) {
+        scheduler->ReadyToRun(parent->syncer);
+        parent->syncer = NULL;
+    }
+    task->next = freeTasks;
+    freeTasks = task;
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::WaitFor
+// 	Wait until every child of "frame" has finished.  Meanwhile, if
+//	this is a worker, run whatever tasks it can find -- most likely
+//	the children themselves; sleep only when there are none.
+//
+//	"worker" is currentThread's record, or NULL if it isn't a worker.
+//	"frame" is the task to wait for the children of.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::WaitFor(TaskWorker *worker, Task *frame)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Task *task;
+
+    while (frame->pending > 0) {
+        task = (worker == NULL) ? NULL : FindWork(worker);
+        if (task != NULL) {
+            (void) interrupt->SetLevel(oldLevel);
+            RunTask(worker, task);
+            (void) interrupt->SetLevel(IntOff);
+        } else {
+            frame->syncer = currentThread;	// the last child wakes us
+            currentThread->Sleep();
+        }
+    }
+    (void) interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::WorkerRoot
+// 	Dummy function because C++ does not allow a pointer to a member
+//	function: the procedure each worker is forked to run.
+//
+//	"worker" is the worker's TaskWorker record.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::WorkerRoot(int worker)
+{
+    TaskWorker *self = (TaskWorker *) worker;
+
+    self->runtime->Work(self);
+}
+
+//----------------------------------------------------------------------
+// TaskRuntime::Work
+// 	A worker's life: run whatever tasks it can find, sleeping when
+//	there are none, until the runtime is deleted.
+//----------------------------------------------------------------------
+
+void
+TaskRuntime::Work(TaskWorker *worker)
+{
+    IntStatus oldLevel = interrupt->SetLevel(IntOff);
+    Task *task;
+
+    for (;;) {
+        task = FindWork(worker);
+        if (task != NULL) {
+            (void) interrupt->SetLevel(oldLevel);
+            RunTask(worker, task);
+            (void) interrupt->SetLevel(IntOff);
+        } else if (stopping) {
+            break;
+        } else {
+            idleWorkers++;		// Push counts us off
+            idle->Sleep();
+        }
+    }
+    (void) interrupt->SetLevel(oldLevel);
+    workersGone->V();
+}
+
 #ifdef USER_PROGRAM
 #include "machine.h"
 
@@ -41,6 +41,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "sysdep.h"
+#include "list.h"
 
 
 #ifdef USER_PROGRAM
@@ -60,7 +61,9 @@
 
 
 // Thread state
-enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED };
+enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, ZOMBIE };
+				// ZOMBIE: finished and stack freed,
+				// waiting to be joined
 
 // external function, dummy routine whose sole job is to call Thread::Print
 extern void ThreadPrint(int arg);
@@ -79,6 +82,7 @@ extern void ThreadPrint(int arg);
 
 class Lock;
 class Condition;
+class WaitGroup;
 class Thread {
 private:
     // NOTE: DO NOT CHANGE the order of these first two members.
@@ -98,6 +102,7 @@ public:
     // basic thread operations
 
     void Join(); //   calling Join to stop the parent thread and run the child thread
+    void BecomeZombie();	// free a finished joinable thread's stack
 
     // dummy function
     bool getFinished() {
@@ -110,6 +115,8 @@ public:
    
 
     void Fork(VoidFunctionPtr func, int arg); 	// Make thread run (*func)(arg)
+    void Fork(VoidFunctionPtr func, int arg, WaitGroup *waitGroup);
+					// ... as a child counted in "waitGroup"
     void Yield();  				// Relinquish the CPU if any
     // other thread is runnable
     void Sleep();  				// Put the thread to sleep and
@@ -121,6 +128,9 @@ public:
     void setStatus(ThreadStatus st) {
         status = st;
     }
+    ThreadStatus getStatus() {
+        return status;
+    }
     char* getName() {
         return (name);
     }
@@ -130,12 +140,23 @@ public:
 
 
     // Part 4
-    void setPriority(int newPriority) {
-        priority = newPriority;
-    }
+    void setPriority(int newPriority);	// change priority, re-positioning
+    // the thread if it is queued
     int getPriority() {
         return priority;
     }
+    HeapElement *getQueueEntry() {
+        return &queueEntry;	// handle used by ready/wait queues
+    }
+    HeapElement *getTimeoutEntry() {
+        return &timeoutEntry;	// handle used by the scheduler's
+    }				// timeout heap
+    void setTimedOut(bool expired) {
+        timedOut = expired;
+    }
+    bool getTimedOut() {
+        return timedOut;	// did our last timed wait expire?
+    }
 
 
 private:
@@ -144,10 +165,10 @@ private:
     // thread values for impelementing the Join
     int isJoinable;     
     bool finished;
-    bool isjoinCalled;
-    Condition *joinCond;
-    Condition *joinCallCond;
-    Lock *joinLock;
+    Thread *joiner;			// parent asleep in Join, or NULL
+
+    WaitGroup *group;			// told when we finish, or NULL
+    int forkArg;			// "arg" we were forked with
   
 
  
@@ -158,6 +179,12 @@ private:
     ThreadStatus status;		// ready, running or blocked
     char* name;
     int priority;
+    HeapElement queueEntry;		// our place on the ready list or on
+    // a wait queue; queueEntry.heap is the
+    // queue we are on (NULL if none)
+    HeapElement timeoutEntry;		// our place on the timeout heap,
+    // while we are in a timed wait
+    bool timedOut;			// TRUE if the timed wait expired
 
     void StackAllocate(VoidFunctionPtr func, int arg);
     // Allocate a stack for thread.
@@ -178,6 +205,279 @@ public:
 #endif
 };
 
+// The following class defines a "stack pool": thread stacks that have
+// been freed, kept for the next threads forked rather than given back
+// to the host and allocated afresh, which costs a system call each way.
+// At most "size" stacks are kept; any more are given back.
+
+class StackPool {
+public:
+    StackPool(int stackSize);	// initialize to empty
+    ~StackPool();		// give every pooled stack back
+
+    int *Allocate();		// a stack of StackSize words
+    void Free(int *stack);	// keep it for reuse, if there is room
+    int NumFree() {
+        return numFree;
+    }
+
+    int getAllocated() {
+        return allocated;	// stacks ever allocated from the host
+    }
+    int getReused() {
+        return reused;		// stacks ever taken from the pool
+    }
+
+private:
+    int **stacks;		// the pooled stacks
+    int size;			// most stacks to keep
+    int numFree;		// stacks in the pool
+    int allocated;
+    int reused;
+};
+
+// The following classes define an "off-CPU profiler", which records
+// where threads block and for how long, when Nachos is run with
+// -op <file>.
+//
+// Each time a thread calls Sleep, the profiler captures its call
+// chain (return addresses, with backtrace()), and when the thread is
+// dispatched again it charges the ticks it spent blocked to that
+// chain.  Chains are kept once each, in a hash table.  Cleanup writes
+// them out in the "folded stack" format that flame graph tools read:
+//
+//	ThreadRoot;SimpleThread;Semaphore::P;WaitQueue::Sleep;Thread::Sleep 120
+//
+// one line per call chain, outermost frame first, then the blocked
+// ticks.  Functions show by name if the symbols are exported (link
+// with -rdynamic); otherwise by address.
+
+#define OffCpuMaxDepth	32	// frames kept per call chain
+
+class OffCpuStack {
+public:
+    void *frames[OffCpuMaxDepth];	// return addresses, innermost first
+    int depth;				// frames in use
+    unsigned hash;			// of the frames, for the table
+    int blocked;			// ticks spent blocked, all told
+    int count;				// times a thread blocked here
+    OffCpuStack *next;			// next chain in the same bucket
+};
+
+class OffCpuProfiler {
+public:
+    OffCpuProfiler();			// start with no call chains
+    ~OffCpuProfiler();
+
+    OffCpuStack *Capture();		// find or add the caller's chain
+    void NoteBlocked(OffCpuStack *where, int ticks);
+					// charge blocked ticks to a chain
+    void Print(char *fileName);		// write folded stacks to
+					// "fileName" (NULL for stdout)
+    int NumStacks() { return numStacks; }
+
+private:
+    OffCpuStack **buckets;		// hash table of call chains
+    int numStacks;			// chains in the table
+};
+
+// The following classes define a "thread pool": a set of worker threads
+// that run submitted procedures, so that a short piece of work costs a
+// queue push and pop rather than a thread's whole life -- stack, Fork,
+// and destruction by the next thread to run.
+//
+// A pool starts "minWorkers" workers, and starts more, up to
+// "maxWorkers", when work is submitted and none is idle.  A worker
+// beyond the minimum that sits idle for "idleTimeout" ticks exits.
+// A fixed pool is one with minWorkers == maxWorkers.
+//
+// Submit() queues (*func)(arg) and returns a handle; the submitter
+// must Join() the handle, which waits until the work has been done.
+// Execute() queues work no one will wait for.  Handles are recycled by
+// the pool, so once the pool is warm, submitting doesn't allocate.
+//
+// Deleting the pool lets the workers finish all the queued work, then
+// waits for them to exit; it must not be done by one of the workers.
+
+class ThreadPool;
+
+class PoolTask {
+public:
+    bool IsDone() {
+        return done;		// has the work been done?
+    }
+    void Join();		// wait until it has, then give the
+				// handle back to the pool
+
+private:
+    friend class ThreadPool;
+
+    VoidFunctionPtr func;	// the work: (*func)(arg)
+    int arg;
+    bool done;			// has it been run?
+    bool detached;		// no one will Join it
+    bool joining;		// someone is waiting in Join
+    ThreadPool *pool;		// the pool it was submitted to
+    PoolTask *next;		// next on the queue, or the free list
+};
+
+class ThreadPool {
+public:
+    ThreadPool(char* debugName, int initialWorkers);	// a fixed pool
+    ThreadPool(char* debugName, int fewest, int most, int timeout);
+				// an elastic one
+    ~ThreadPool();		// run all queued work, then stop
+
+    PoolTask *Submit(VoidFunctionPtr func, int arg);	// queue work,
+				// return a handle to Join
+    void Execute(VoidFunctionPtr func, int arg);	// queue work,
+				// without a handle
+
+    int NumWorkers() {
+        return numWorkers;	// workers alive now
+    }
+    int getWorkersStarted() {
+        return workersStarted;	// workers ever started
+    }
+
+private:
+    friend class PoolTask;
+
+    char* name;			// useful for debugging
+    int minWorkers;		// workers kept even when idle
+    int maxWorkers;		// most workers at a time
+    int idleTimeout;		// ticks before an extra idle worker exits
+    int numWorkers;		// workers alive
+    int idleWorkers;		// workers waiting for work, not signalled
+    int workersStarted;		// workers ever started
+    bool stopping;		// is the pool being deleted?
+
+    PoolTask *first, *last;	// queued work, oldest first
+    PoolTask *freeTasks;	// handles to reuse
+    Lock *lock;			// protects all of the above
+    Condition *workQueued;	// idle workers wait here
+    Condition *workDone;	// Join waits here
+    Condition *workersGone;	// the destructor waits here
+
+    void Setup(char* debugName, int fewest, int most, int timeout);
+    PoolTask *Queue(VoidFunctionPtr func, int arg, bool detached);
+    void StartWorker();		// fork another worker
+    void Recycle(PoolTask *task);	// put a handle on the free list
+    void Work();		// a worker's main loop
+    static void WorkerRoot(int pool);	// entry point for Fork
+};
+
+// The following classes define a "task runtime", for fork-join
+// parallelism in the style of Cilk: a task may Spawn child tasks, which
+// may run in parallel with it, and then Sync to wait for all of them.
+// Every task implicitly Syncs before it finishes.
+//
+// Spawning a task costs a push onto a deque, not a thread.  Each worker
+// thread pushes and pops its own deque at the bottom, so it runs its
+// work depth-first; a worker with nothing to do steals from the top of
+// someone else's deque -- the oldest task there, and so usually the
+// biggest.  A task can't be suspended apart from the thread running
+// it, so a worker waiting in Sync runs other tasks meanwhile, and only
+// sleeps when there are none to be had.
+//
+// As everywhere else in Nachos, the deques are made atomic by turning
+// off interrupts, so the owner and a thief never race.
+
+class TaskRuntime;
+class WaitQueue;
+class Semaphore;
+
+class Task {
+private:
+    friend class TaskRuntime;
+
+    VoidFunctionPtr func;	// the work: (*func)(arg)
+    int arg;
+    Task *parent;		// the task that spawned this one
+    int pending;		// children spawned and not yet finished
+    Thread *syncer;		// asleep until "pending" is 0, or NULL
+    Task *next;			// next on the free list
+};
+
+class TaskDeque {
+public:
+    TaskDeque();		// initialize to empty
+    ~TaskDeque();		// de-allocate; must be empty
+
+    void Push(Task *task);	// at the bottom, by the owner
+    Task *Pop();		// from the bottom, by the owner
+    Task *Steal();		// from the top, by anyone else
+    bool IsEmpty() {
+        return top == bottom;
+    }
+
+private:
+    Task **tasks;		// circular array, grown when full
+    int capacity;		// a power of 2
+    int top;			// oldest task is at tasks[top % capacity]
+    int bottom;			// next Push goes to tasks[bottom % capacity]
+};
+
+// Internal data structure kept public so that TaskRuntime can access
+// it directly.
+
+class TaskWorker {
+public:
+    Thread *thread;		// the worker thread
+    TaskDeque *deque;		// tasks it has spawned
+    Task *current;		// the task it is running, NULL if none
+    int victim;			// where to try to steal from next
+    TaskRuntime *runtime;	// the runtime it belongs to
+};
+
+class TaskRuntime {
+public:
+    TaskRuntime(char* debugName, int count);	// fork "count" workers
+    ~TaskRuntime();		// stop the workers; no task may be running
+
+    void Run(VoidFunctionPtr func, int arg);	// from outside the
+				// runtime: run a task and its children
+    void Spawn(VoidFunctionPtr func, int arg);	// from a task: start
+				// a child, which may run in parallel
+    void Sync();		// from a task: wait for all its children
+
+    int NumWorkers() {
+        return numWorkers;
+    }
+    bool InTask() {
+        return CurrentWorker() != NULL;	// is currentThread running one?
+    }
+    int getSpawned() {
+        return spawned;		// tasks ever spawned
+    }
+    int getSteals() {
+        return steals;		// tasks ever stolen
+    }
+
+private:
+    char* name;			// useful for debugging
+    int numWorkers;
+    TaskWorker *workers;	// one per worker thread
+    int idleWorkers;		// workers asleep on "idle", not woken
+    bool stopping;		// is the runtime being deleted?
+    WaitQueue *idle;		// workers with nothing to do sleep here
+    Semaphore *workersGone;	// each worker V's it as it exits
+    Task *freeTasks;		// tasks to reuse
+    int spawned;
+    int steals;
+
+    TaskWorker *CurrentWorker();	// currentThread's record, or NULL
+    Task *NewTask(VoidFunctionPtr func, int arg, Task *parent);
+    void Push(TaskDeque *deque, Task *task);	// and wake a worker
+    Task *FindWork(TaskWorker *worker);	// pop our own, or steal
+    void RunTask(TaskWorker *worker, Task *task);	// run it, Sync,
+						// and tell its parent
+    void WaitFor(TaskWorker *worker, Task *frame);	// Sync, for
+						// either a task or Run
+    void Work(TaskWorker *worker);	// a worker's main loop
+    static void WorkerRoot(int worker);	// entry point for Fork
+};
+
 // Magical machine-dependent routines, defined in switch.s
 
 extern "C" {
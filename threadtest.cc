@@ -6,10 +6,31 @@
 #include "copyright.h"
 #include "system.h"
 #include "synch.h"
+#include "synchlist.h"
+#include "parallel.h"
+#include "future.h"
+
+#include <sys/time.h>
 
 // testnum is set in main.cc
 int testnum = 1;
 
+//----------------------------------------------------------------------
+// HostSeconds
+//  Wall-clock time on the host, for the benchmarks below.  Simulated
+//  time (stats->totalTicks) only advances when interrupts are
+//  re-enabled, so it cannot see costs that avoid doing that.
+//----------------------------------------------------------------------
+
+static double
+HostSeconds()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
 //----------------------------------------------------------------------
 // SimpleThread
 //  Loop 5 times, yielding the CPU to another ready thread 
@@ -473,6 +494,7 @@ deleteWaitLock1(int param){
     printf("Acquiring lock once\n");
     heldLock->Acquire();
     printf("Acquired lock once. Yielding to different thread\n");
+    currentThread->setPriority(0);     // so the Yield lets the others run
     currentThread->Yield();
     printf("Releasing first lock\n");
     heldLock->Release();
@@ -990,8 +1012,8 @@ void testContextSwitchCaseThree() {
 
 //----------------------------------------------------------------------
 // testNoSort
-// Tests to see that a thread is not re-sorted when its priority is
-// changed.
+// Tests to see that a thread on the ready list is re-sorted as soon
+// as its priority is changed.
 //----------------------------------------------------------------------
 void thr1(int param) {
     printf("Thread with priority 4 ran.\n");
@@ -1000,7 +1022,7 @@ void thr2(int param) {
     printf("Thread with priority 4v2 ran.\n");
 }
 void thr3(int param) {
-    printf("Thread with priority 3 ran.\n");
+    printf("Thread with priority 3 ran. Success if it ran last.\n");
 }
 
 void testNoSort() {
@@ -1146,6 +1168,2267 @@ void testWaitPrioritySema() {
     t->Fork(wakeSem,0);
 }
 
+//----------------------------------------------------------------------
+// testBoostWaiting
+// Tests to see that raising the priority of a thread that is already
+// waiting on a semaphore moves it to the front of the wait queue, so
+// it is the one woken up by the next V().
+//----------------------------------------------------------------------
+
+Semaphore *boostSem = NULL;
+Thread *boostLow = NULL;
+void boostWaiter(int param) {
+    printf("Thread %s waiting with priority %d.\n",
+           currentThread->getName(), currentThread->getPriority());
+    boostSem->P();
+    printf("Thread %s woke up.\n", currentThread->getName());
+}
+void boostWaker(int param) {
+    printf("Boosting thread %s to priority 5 while it waits.\n",
+           boostLow->getName());
+    boostLow->setPriority(5);
+    boostSem->V();
+    boostSem->V();
+    printf("Success if \"low\" woke up before \"high\".\n");
+}
+
+void testBoostWaiting() {
+    boostSem = new Semaphore("boostSem", 0);
+
+    Thread *t = new Thread("high");
+    t->setPriority(3);
+    t->Fork(boostWaiter,0);
+
+    boostLow = new Thread("low");
+    boostLow->setPriority(2);
+    boostLow->Fork(boostWaiter,0);
+
+    t = new Thread("waker");
+    t->setPriority(1);
+    t->Fork(boostWaker,0);
+}
+
+//----------------------------------------------------------------------
+// benchUncontendedLock
+// Measures uncontended Lock::Acquire/Release pairs per second, which
+// take the compare-and-swap fast path, against Semaphore P/V pairs on
+// a binary semaphore, which always disable and re-enable interrupts.
+//----------------------------------------------------------------------
+
+void benchUncontendedLock() {
+    const int pairs = 1000000;
+    Lock *lock = new Lock("benchLock");
+    Semaphore *sem = new Semaphore("benchSem", 1);
+    double start, lockSecs, semSecs;
+    int startTicks, lockTicks, semTicks;
+    int i;
+
+    start = HostSeconds();
+    startTicks = stats->totalTicks;
+    for (i = 0; i < pairs; i++) {
+        lock->Acquire();
+        lock->Release();
+    }
+    lockSecs = HostSeconds() - start;
+    lockTicks = stats->totalTicks - startTicks;
+
+    start = HostSeconds();
+    startTicks = stats->totalTicks;
+    for (i = 0; i < pairs; i++) {
+        sem->P();
+        sem->V();
+    }
+    semSecs = HostSeconds() - start;
+    semTicks = stats->totalTicks - startTicks;
+
+    printf("%d uncontended pairs:\n", pairs);
+    printf("  Lock Acquire/Release: %.0f pairs/sec, %d ticks\n",
+           pairs / lockSecs, lockTicks);
+    printf("  Semaphore P/V:        %.0f pairs/sec, %d ticks\n",
+           pairs / semSecs, semTicks);
+
+    delete lock;
+    delete sem;
+}
+
+//----------------------------------------------------------------------
+// testAdaptiveLock
+// Threads contend for an AdaptiveLock, yielding while they hold it.
+// Mutual exclusion must hold; since Nachos has one CPU the owner is
+// never running when someone else wants the lock, so every contended
+// acquire should block without spinning.
+//----------------------------------------------------------------------
+
+AdaptiveLock *adaptiveLock = NULL;
+int adaptiveInside = 0;
+int adaptiveDone = 0;
+
+void adaptiveWorker(int which) {
+    for (int i = 0; i < 3; i++) {
+        adaptiveLock->Acquire();
+        ASSERT(adaptiveInside == 0);
+        adaptiveInside++;
+        printf("Thread %d has the lock.\n", which);
+        currentThread->Yield();
+        adaptiveInside--;
+        adaptiveLock->Release();
+        currentThread->Yield();
+    }
+    if (++adaptiveDone == 3)
+        adaptiveLock->PrintStats();
+}
+
+void testAdaptiveLock() {
+    adaptiveLock = new AdaptiveLock("adaptiveLock");
+
+    for (int i = 0; i < 3; i++) {
+        Thread *t = new Thread("adaptive");
+        t->Fork(adaptiveWorker, i);
+    }
+}
+
+//----------------------------------------------------------------------
+// testRWLock
+// Reader 0 takes an RWLock to read and yields, then a writer and
+// reader 1 arrive.  Without writer preference reader 1 joins reader 0
+// and the writer goes last; with it, reader 1 waits for the writer.
+//----------------------------------------------------------------------
+
+RWLock *rwLock = NULL;
+Semaphore *rwDone = NULL;
+
+void rwReader(int which) {
+    rwLock->ReadAcquire();
+    printf("Reader %d in, %d reading.\n", which, rwLock->NumReaders());
+    currentThread->Yield();
+    currentThread->Yield();
+    printf("Reader %d out.\n", which);
+    rwLock->ReadRelease();
+    rwDone->V();
+}
+
+void rwWriter(int which) {
+    rwLock->WriteAcquire();
+    ASSERT(rwLock->NumReaders() == 0);
+    printf("Writer in.\n");
+    currentThread->Yield();
+    printf("Writer out.\n");
+    rwLock->WriteRelease();
+    rwDone->V();
+}
+
+void rwScenario(bool preferWriters) {
+    Thread *t;
+
+    rwLock = new RWLock("rwLock", preferWriters);
+    t = new Thread("reader 0");
+    t->Fork(rwReader, 0);
+    t = new Thread("writer");
+    t->Fork(rwWriter, 0);
+    t = new Thread("reader 1");
+    t->Fork(rwReader, 1);
+    for (int i = 0; i < 3; i++)
+        rwDone->P();
+    delete rwLock;
+}
+
+void testRWLock() {
+    rwDone = new Semaphore("rwDone", 0);
+
+    printf("Without writer preference (success if writer is last):\n");
+    rwScenario(FALSE);
+    printf("With writer preference (success if writer is second):\n");
+    rwScenario(TRUE);
+    delete rwDone;
+}
+
+//----------------------------------------------------------------------
+// benchRWLock
+// Sweeps the share of reads in a mixed workload, running it once under
+// a plain Lock and once under an RWLock.  Each of the workers does
+// a number of operations, and yields inside every one to stand for
+// time spent holding the lock.  Under the Lock, that just lets other
+// workers run into the lock and block; under the RWLock, other readers
+// get in.  Reports simulated ticks, and the average number of workers
+// inside the lock (1.0 means fully serialized).
+//----------------------------------------------------------------------
+
+#define RWBenchWorkers	8
+#define RWBenchOps	500
+
+Lock *rwBenchLock = NULL;
+int rwBenchReadPct;		// share of operations that are reads
+int rwBenchInside;		// workers holding the lock right now
+int rwBenchSamples;		// operations performed
+int rwBenchInsideSum;		// sum of rwBenchInside seen by each one
+
+void rwBenchWorker(int which) {
+    for (int i = 0; i < RWBenchOps; i++) {
+        bool read = ((i * 7 + which * 13) % 100) < rwBenchReadPct;
+
+        if (rwBenchLock != NULL)
+            rwBenchLock->Acquire();
+        else if (read)
+            rwLock->ReadAcquire();
+        else
+            rwLock->WriteAcquire();
+
+        rwBenchInside++;
+        currentThread->Yield();		// "work" while holding the lock
+        rwBenchInsideSum += rwBenchInside;
+        rwBenchSamples++;
+        rwBenchInside--;
+
+        if (rwBenchLock != NULL)
+            rwBenchLock->Release();
+        else if (read)
+            rwLock->ReadRelease();
+        else
+            rwLock->WriteRelease();
+    }
+    rwDone->V();
+}
+
+void rwBenchRun(bool useRWLock, int readPct) {
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    Thread *t;
+
+    rwBenchLock = useRWLock ? NULL : new Lock("rwBenchLock");
+    rwBenchReadPct = readPct;
+    rwBenchInside = rwBenchSamples = rwBenchInsideSum = 0;
+    for (int i = 0; i < RWBenchWorkers; i++) {
+        t = new Thread("rwBenchWorker");
+        t->Fork(rwBenchWorker, i);
+    }
+    for (int i = 0; i < RWBenchWorkers; i++)
+        rwDone->P();
+    secs = HostSeconds() - start;
+
+    printf("  %3d%% reads, %-6s: %8d ticks, %8.0f ops/sec, "
+           "%.2f inside on average\n", readPct, useRWLock ? "RWLock" : "Lock",
+           stats->totalTicks - startTicks, rwBenchSamples / secs,
+           (double)rwBenchInsideSum / rwBenchSamples);
+    delete rwBenchLock;
+}
+
+void benchRWLock() {
+    static int readPcts[] = { 0, 50, 90, 99, 100 };
+
+    rwDone = new Semaphore("rwDone", 0);
+    rwLock = new RWLock("rwBenchRWLock");
+    printf("%d workers, %d operations each:\n", RWBenchWorkers, RWBenchOps);
+    for (int i = 0; i < (int)(sizeof(readPcts) / sizeof(int)); i++) {
+        rwBenchRun(FALSE, readPcts[i]);
+        rwBenchRun(TRUE, readPcts[i]);
+    }
+    delete rwLock;
+    delete rwDone;
+}
+
+//----------------------------------------------------------------------
+// testHandoff
+// Two threads take turns with a Lock, and then with a binary
+// Semaphore, each grabbing it again right after letting it go.  With
+// barging, the running thread wins every time and the waiter it just
+// woke goes back to sleep -- a wasted wakeup.  With handoff, the
+// waiter already owns the lock (or unit) when it wakes, so there are
+// no wasted wakeups and the threads alternate.
+//----------------------------------------------------------------------
+
+static Semaphore *handoffDone = NULL;
+Lock *handoffLock = NULL;
+Semaphore *handoffSem = NULL;
+
+void handoffWorker(int which) {
+    for (int i = 0; i < 5; i++) {
+        if (handoffLock != NULL)
+            handoffLock->Acquire();
+        else
+            handoffSem->P();
+        currentThread->Yield();		// let the other thread queue up
+        if (handoffLock != NULL)
+            handoffLock->Release();
+        else
+            handoffSem->V();
+    }
+    handoffDone->V();
+}
+
+void handoffRun(bool useLock, bool handoff) {
+    Thread *t;
+
+    if (useLock) {
+        handoffLock = new Lock("handoffLock");
+        handoffLock->setHandoff(handoff);
+    } else {
+        handoffSem = new Semaphore("handoffSem", 1);
+        handoffSem->setHandoff(handoff);
+    }
+    for (int i = 0; i < 2; i++) {
+        t = new Thread("handoffWorker");
+        t->Fork(handoffWorker, i);
+    }
+    handoffDone->P();
+    handoffDone->P();
+
+    printf("%-10s %-7s: %d wasted wakeups\n",
+           useLock ? "Lock," : "Semaphore,", handoff ? "handoff" : "barging",
+           useLock ? handoffLock->getWastedWakeups()
+                   : handoffSem->getWastedWakeups());
+    delete handoffLock;
+    delete handoffSem;
+    handoffLock = NULL;
+    handoffSem = NULL;
+}
+
+void testHandoff() {
+    handoffDone = new Semaphore("handoffDone", 0);
+
+    printf("Success if there are no wasted wakeups with handoff:\n");
+    handoffRun(TRUE, FALSE);
+    handoffRun(TRUE, TRUE);
+    handoffRun(FALSE, FALSE);
+    handoffRun(FALSE, TRUE);
+    delete handoffDone;
+}
+
+//----------------------------------------------------------------------
+// testWaitMorphing
+// Five threads of different priorities wait on a condition.  The
+// broadcaster yields while still holding the lock: since the waiters
+// were moved onto the lock's queue, none of them can run yet.  After
+// Release they get the lock one at a time, highest priority first.
+// Run once with lock handoff and once with barging.
+//----------------------------------------------------------------------
+
+static Semaphore *morphDone = NULL;
+Lock *morphLock = NULL;
+Condition *morphCond = NULL;
+int morphWaiting = 0;
+int morphRan = 0;
+
+void morphWaiter(int which) {
+    morphLock->Acquire();
+    morphWaiting++;
+    morphCond->Wait(morphLock);
+    ASSERT(morphLock->isHeldByCurrentThread());
+    morphRan++;
+    printf("Waiter with priority %d has the lock.\n", which);
+    morphLock->Release();
+    morphDone->V();
+}
+
+void morphRun(bool handoff) {
+    Thread *t;
+
+    morphLock = new Lock("morphLock");
+    morphLock->setHandoff(handoff);
+    morphCond = new Condition("morphCond");
+    morphWaiting = morphRan = 0;
+    for (int i = 1; i <= 5; i++) {
+        t = new Thread("morphWaiter");
+        t->setPriority((i * 3) % 5);
+        t->Fork(morphWaiter, (i * 3) % 5);
+    }
+    while (morphWaiting < 5)
+        currentThread->Yield();
+
+    morphLock->Acquire();
+    morphCond->Broadcast(morphLock);
+    currentThread->Yield();
+    printf("Broadcaster yielded holding the lock; %d waiters ran "
+           "(success if 0).\n", morphRan);
+    morphLock->Release();
+    for (int i = 0; i < 5; i++)
+        morphDone->P();
+    printf("%d wasted wakeups.\n", morphLock->getWastedWakeups());
+
+    delete morphCond;
+    delete morphLock;
+}
+
+void testWaitMorphing() {
+    morphDone = new Semaphore("morphDone", 0);
+
+    printf("With handoff:\n");
+    morphRun(TRUE);
+    printf("With barging:\n");
+    morphRun(FALSE);
+    delete morphDone;
+}
+
+//----------------------------------------------------------------------
+// testTimedWaits
+// Timed P, Acquire and Wait, first each on its own -- timing out, and
+// succeeding in time -- then 1000 timed P's at once, with deadlines
+// spread over 5000 ticks (after the 100000 or so it takes to get them
+// all waiting), of which 300 are satisfied by V's and the other 700
+// must expire, each no earlier than its deadline.
+//----------------------------------------------------------------------
+
+#define TimedWaiters	1000
+
+static Semaphore *timedDone = NULL;
+Semaphore *timedSem = NULL;
+Lock *timedLock = NULL;
+int timedWoken = 0;
+int timedExpired = 0;
+bool timedHeld = FALSE;
+
+void timedSignaller(int dummy) {
+    timedSem->V();
+}
+
+void timedHolder(int ticks) {
+    timedLock->Acquire();
+    timedHeld = TRUE;
+    (void) timedSem->P(ticks);		// hold the lock for "ticks" ticks
+    timedLock->Release();
+}
+
+void timedWaiter(int ticks) {
+    int deadline = stats->totalTicks + ticks;
+
+    if (timedSem->P(ticks)) {
+        timedWoken++;
+    } else {
+        ASSERT(stats->totalTicks >= deadline);
+        timedExpired++;
+    }
+    timedDone->V();
+}
+
+void testTimedWaits() {
+    Condition *cond = new Condition("timedCond");
+    Thread *t;
+    int start;
+    bool ok;
+
+    timedDone = new Semaphore("timedDone", 0);
+    timedSem = new Semaphore("timedSem", 0);
+    timedLock = new Lock("timedLock");
+
+    start = stats->totalTicks;
+    ok = timedSem->P(100);
+    printf("P(100) with no V: %s after %d ticks (success if FALSE, >= 100).\n",
+           ok ? "TRUE" : "FALSE", stats->totalTicks - start);
+
+    t = new Thread("timedSignaller");
+    t->Fork(timedSignaller, 0);
+    ok = timedSem->P(1000);
+    printf("P(1000) with a V: %s (success if TRUE).\n", ok ? "TRUE" : "FALSE");
+
+    t = new Thread("timedHolder");
+    t->Fork(timedHolder, 500);
+    while (!timedHeld)
+        currentThread->Yield();
+    ok = timedLock->Acquire(100);
+    printf("Acquire(100) of a lock held for 500 ticks: %s (success if FALSE).\n",
+           ok ? "TRUE" : "FALSE");
+    ok = timedLock->Acquire(1000);
+    printf("Acquire(1000) of the same lock: %s (success if TRUE).\n",
+           ok ? "TRUE" : "FALSE");
+
+    start = stats->totalTicks;
+    ok = cond->Wait(timedLock, 100);
+    printf("Wait(100) with no Signal: %s after %d ticks, lock %s "
+           "(success if FALSE, >= 100, held).\n", ok ? "TRUE" : "FALSE",
+           stats->totalTicks - start,
+           timedLock->isHeldByCurrentThread() ? "held" : "not held");
+    timedLock->Release();
+
+    start = stats->totalTicks;
+    for (int i = 0; i < TimedWaiters; i++) {
+        t = new Thread("timedWaiter");
+        t->Fork(timedWaiter, 100000 + (i * 37) % 5000);
+    }
+    currentThread->Yield();		// let them all start waiting
+    for (int i = 0; i < 300; i++)
+        timedSem->V();
+    for (int i = 0; i < TimedWaiters; i++)
+        timedDone->P();
+    printf("%d timed waiters: %d woken, %d timed out, in %d ticks "
+           "(success if 300 and 700).\n", TimedWaiters, timedWoken,
+           timedExpired, stats->totalTicks - start);
+
+    delete cond;
+    delete timedLock;
+    delete timedSem;
+    delete timedDone;
+}
+
+//----------------------------------------------------------------------
+// testTryOperations
+// An event-loop thread polls a Lock, a Semaphore and a SynchList
+// with TryAcquire, TryP and TryRemove.  Polls that fail must not take
+// any simulated time (they never disable interrupts); once another
+// thread has made the resources available, the polls must succeed.
+//----------------------------------------------------------------------
+
+Lock *tryLock = NULL;
+Semaphore *trySem = NULL;
+SynchList *tryList = NULL;
+int tryStage = 0;		// 1: holder has the lock, 2: polls done,
+				// 3: holder has made everything available
+
+void tryHolder(int dummy) {
+    tryLock->Acquire();
+    tryStage = 1;
+    while (tryStage == 1)
+        currentThread->Yield();		// poller runs while we hold the lock
+    tryLock->Release();
+    trySem->V();
+    tryList->Append((void *)"event");
+    tryStage = 3;
+}
+
+void testTryOperations() {
+    Thread *t = new Thread("tryHolder");
+    int start, failures = 0;
+    char *item;
+
+    tryLock = new Lock("tryLock");
+    trySem = new Semaphore("trySem", 0);
+    tryList = new SynchList();
+
+    t->Fork(tryHolder, 0);
+    while (tryStage != 1)
+        currentThread->Yield();		// let the holder take the lock
+
+    start = stats->totalTicks;
+    for (int i = 0; i < 1000; i++) {
+        if (tryLock->TryAcquire())
+            tryLock->Release();
+        else
+            failures++;
+        if (trySem->TryP())
+            trySem->V();
+        else
+            failures++;
+        if (tryList->TryRemove() != NULL)
+            printf("Removed an item from an empty list!\n");
+        else
+            failures++;
+    }
+    printf("%d failed polls took %d ticks (success if 3000 and 0).\n",
+           failures, stats->totalTicks - start);
+
+    tryStage = 2;
+    while (tryStage != 3)
+        currentThread->Yield();		// let the holder finish
+    printf("TryAcquire %s, TryP %s",
+           tryLock->TryAcquire() ? "succeeded" : "failed",
+           trySem->TryP() ? "succeeded" : "failed");
+    item = (char *)tryList->TryRemove();
+    printf(", TryRemove %s (success if all succeeded).\n",
+           item != NULL ? "succeeded" : "failed");
+    tryLock->Release();
+
+    delete tryList;
+    delete trySem;
+    delete tryLock;
+}
+
+//----------------------------------------------------------------------
+// testBarrier
+// Four threads of different priorities go through three phases of a
+// Barrier.  No thread may start phase p+1 before all have finished
+// phase p, and each phase must have exactly one serial thread.
+//----------------------------------------------------------------------
+
+#define BarrierThreads	4
+#define BarrierPhases	3
+
+static Semaphore *barrierThreadsDone = NULL;
+Barrier *barrier = NULL;
+int barrierDone[BarrierPhases];		// threads done with each phase
+int barrierSerial[BarrierPhases];	// serial threads seen in each phase
+
+void barrierWorker(int which) {
+    for (int phase = 0; phase < BarrierPhases; phase++) {
+        if (phase > 0)
+            ASSERT(barrierDone[phase - 1] == BarrierThreads);
+        barrierDone[phase]++;
+        currentThread->Yield();
+        if (barrier->Wait()) {
+            printf("Thread %d was the serial thread of phase %d.\n",
+                   which, phase);
+            barrierSerial[phase]++;
+        }
+    }
+    barrierThreadsDone->V();
+}
+
+void testBarrier() {
+    Thread *t;
+
+    barrierThreadsDone = new Semaphore("barrierThreadsDone", 0);
+    barrier = new Barrier("barrier", BarrierThreads);
+    for (int i = 0; i < BarrierThreads; i++) {
+        t = new Thread("barrierWorker");
+        t->setPriority(i % 2);
+        t->Fork(barrierWorker, i);
+    }
+    for (int i = 0; i < BarrierThreads; i++)
+        barrierThreadsDone->P();
+    for (int phase = 0; phase < BarrierPhases; phase++)
+        ASSERT(barrierSerial[phase] == 1);
+    printf("%d phases completed (success if %d).\n",
+           barrier->getGeneration(), BarrierPhases);
+    delete barrier;
+    delete barrierThreadsDone;
+}
+
+//----------------------------------------------------------------------
+// benchBarrier
+// Phases per second through a Barrier, against the barrier our phased
+// workloads used to build from a Lock and Condition::Broadcast, with
+// 2 to 10000 participants.  Each run does about 100000 waits.
+//----------------------------------------------------------------------
+
+static Semaphore *barrierBenchDone = NULL;
+Lock *cvBarrierLock = NULL;
+Condition *cvBarrierCond = NULL;
+int cvBarrierCount, cvBarrierArrived, cvBarrierGeneration;
+int barrierBenchPhases;
+
+void cvBarrierWait() {
+    cvBarrierLock->Acquire();
+    int myGeneration = cvBarrierGeneration;
+    if (++cvBarrierArrived == cvBarrierCount) {
+        cvBarrierArrived = 0;
+        cvBarrierGeneration++;
+        cvBarrierCond->Broadcast(cvBarrierLock);
+    } else {
+        while (cvBarrierGeneration == myGeneration)
+            cvBarrierCond->Wait(cvBarrierLock);
+    }
+    cvBarrierLock->Release();
+}
+
+void barrierBenchWorker(int useBarrier) {
+    for (int i = 0; i < barrierBenchPhases; i++) {
+        if (useBarrier)
+            (void) barrier->Wait();
+        else
+            cvBarrierWait();
+    }
+    barrierBenchDone->V();
+}
+
+void barrierBenchRun(bool useBarrier, int n) {
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    Thread *t;
+
+    for (int i = 0; i < n; i++) {
+        t = new Thread("barrierBenchWorker");
+        t->Fork(barrierBenchWorker, useBarrier);
+    }
+    for (int i = 0; i < n; i++)
+        barrierBenchDone->P();
+    secs = HostSeconds() - start;
+
+    printf("  %5d threads, %-17s: %9.0f phases/sec, %8d ticks/phase\n",
+           n, useBarrier ? "Barrier" : "Lock + Condition",
+           barrierBenchPhases / secs,
+           (stats->totalTicks - startTicks) / barrierBenchPhases);
+}
+
+void benchBarrier() {
+    static int sizes[] = { 2, 10, 100, 1000, 10000 };
+
+    barrierBenchDone = new Semaphore("barrierBenchDone", 0);
+    cvBarrierLock = new Lock("cvBarrierLock");
+    cvBarrierCond = new Condition("cvBarrierCond");
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(int)); i++) {
+        barrierBenchPhases = 100000 / sizes[i];
+        barrier = new Barrier("benchBarrier", sizes[i]);
+        cvBarrierCount = sizes[i];
+        cvBarrierArrived = 0;
+        barrierBenchRun(TRUE, sizes[i]);
+        barrierBenchRun(FALSE, sizes[i]);
+        delete barrier;
+    }
+    delete cvBarrierCond;
+    delete cvBarrierLock;
+    delete barrierBenchDone;
+}
+
+//----------------------------------------------------------------------
+// testCompactLocks
+// Sets up 100000 CompactLocks, which take one word each -- 400000
+// bytes on the 32-bit hosts Nachos builds for -- and compares that
+// with what the same number of Locks would take.  Then workers
+// contend for 8 of them, and pass items through a CompactCondition.
+// The parking lot must hold queues only while threads are waiting.
+//----------------------------------------------------------------------
+
+#define CompactLocks	100000
+#define CompactWorkers	6
+
+static Semaphore *compactDone = NULL;
+CompactLock *compactLocks = NULL;
+CompactLock *compactQueueLock = NULL;
+CompactCondition *compactNotEmpty = NULL;
+int compactCounts[8];
+int compactItems = 0;
+int compactPeakQueues = 0;
+
+void compactWorker(int which) {
+    for (int i = 0; i < 20; i++) {
+        int l = (i + which % 2) % 8;	// two groups, on two locks
+
+        compactLocks[l].Acquire();
+        compactCounts[l]++;
+        currentThread->Yield();		// others pile up on the lock
+        if (parkingLot->NumQueues() > compactPeakQueues)
+            compactPeakQueues = parkingLot->NumQueues();
+        compactLocks[l].Release();
+    }
+
+    // Half of the workers consume an item that the other half produce.
+    compactQueueLock->Acquire();
+    if (which % 2 == 0) {
+        while (compactItems == 0)
+            compactNotEmpty->Wait(compactQueueLock);
+        compactItems--;
+    } else {
+        compactItems++;
+        compactNotEmpty->Signal(compactQueueLock);
+    }
+    compactQueueLock->Release();
+    compactDone->V();
+}
+
+void testCompactLocks() {
+    Thread *t;
+    int total = 0;
+
+    printf("%d CompactLocks: %d bytes; %d Locks: at least %d bytes.\n",
+           CompactLocks, (int)(CompactLocks * sizeof(CompactLock)),
+           CompactLocks, (int)(CompactLocks * (sizeof(Lock)
+                + sizeof(WaitQueue) + sizeof(PriorityHeap))));
+
+    compactDone = new Semaphore("compactDone", 0);
+    compactLocks = new CompactLock[CompactLocks];
+    compactQueueLock = new CompactLock;
+    compactNotEmpty = new CompactCondition;
+    for (int i = 0; i < CompactWorkers; i++) {
+        t = new Thread("compactWorker");
+        t->Fork(compactWorker, i);
+    }
+    for (int i = 0; i < CompactWorkers; i++)
+        compactDone->P();
+
+    for (int i = 0; i < 8; i++)
+        total += compactCounts[i];
+    printf("%d acquisitions (success if %d); up to %d parked queues, "
+           "%d left (success if 0).\n", total, CompactWorkers * 20,
+           compactPeakQueues, parkingLot->NumQueues());
+
+    delete compactNotEmpty;
+    delete compactQueueLock;
+    delete [] compactLocks;
+    delete compactDone;
+}
+
+//----------------------------------------------------------------------
+// testLockProfiler
+// Workers take a hot lock, holding it across a Yield so the others
+// queue up, and each takes its own cold lock, which no one else wants.
+// Then half of them hand items to the other half through a Condition.
+// The report should put "hot" first, with every worker as a waiter,
+// and the cold locks, added up under one name, with no contention.
+// Profiles into its own LockProfiler if Nachos wasn't run with -lp.
+//----------------------------------------------------------------------
+
+#define ProfileWorkers	4
+
+static Semaphore *profileDone = NULL;
+Lock *profileHot = NULL;
+Lock *profileItemLock = NULL;
+Condition *profileNotEmpty = NULL;
+int profileItems = 0;
+
+void profileWorker(int which) {
+    Lock *cold = new Lock("cold");
+
+    for (int i = 0; i < 10; i++) {
+        profileHot->Acquire();
+        currentThread->Yield();		// others pile up on the lock
+        profileHot->Release();
+
+        cold->Acquire();
+        cold->Release();
+    }
+    delete cold;
+
+    profileItemLock->Acquire();
+    if (which % 2 == 0) {
+        while (profileItems == 0)
+            profileNotEmpty->Wait(profileItemLock);
+        profileItems--;
+    } else {
+        profileItems++;
+        profileNotEmpty->Signal(profileItemLock);
+    }
+    profileItemLock->Release();
+    profileDone->V();
+}
+
+void testLockProfiler() {
+    LockProfiler *ownProfiler = NULL;
+    Thread *t;
+
+    if (lockProfiler == NULL)
+        lockProfiler = ownProfiler = new LockProfiler();
+
+    profileDone = new Semaphore("profileDone", 0);
+    profileHot = new Lock("hot");
+    profileHot->setHandoff(TRUE);	// so a releaser can't barge back in
+    profileItemLock = new Lock("items");
+    profileNotEmpty = new Condition("notEmpty");
+    for (int i = 0; i < ProfileWorkers; i++) {
+        t = new Thread("profileWorker");
+        t->Fork(profileWorker, i);
+    }
+    for (int i = 0; i < ProfileWorkers; i++)
+        profileDone->P();
+
+    if (ownProfiler != NULL) {
+        ownProfiler->Print();
+        lockProfiler = NULL;
+    }
+    delete profileNotEmpty;
+    delete profileItemLock;
+    delete profileHot;
+    delete profileDone;
+    delete ownProfiler;
+}
+
+//----------------------------------------------------------------------
+// testOffCpuProfiler
+// Workers block in three places: on a lock held across Yields, on a
+// semaphore, and in Join.  Prints the folded stacks, which should
+// show each of those call chains with the ticks blocked in it.
+// Profiles into its own OffCpuProfiler if Nachos wasn't run with -op.
+//----------------------------------------------------------------------
+
+static Semaphore *offCpuDone = NULL;
+Lock *offCpuLock = NULL;
+Semaphore *offCpuGo = NULL;
+
+void offCpuLockWorker(int which) {
+    offCpuLock->Acquire();
+    for (int i = 0; i < 5; i++)
+        currentThread->Yield();		// others block on the lock
+    offCpuLock->Release();
+    offCpuDone->V();
+}
+
+void offCpuSemaphoreWorker(int which) {
+    offCpuGo->P();
+    offCpuDone->V();
+}
+
+void offCpuJoinee(int which) {
+    for (int i = 0; i < 10; i++)
+        currentThread->Yield();
+}
+
+void testOffCpuProfiler() {
+    OffCpuProfiler *ownProfiler = NULL;
+    Thread *t;
+
+    if (offCpuProfiler == NULL)
+        offCpuProfiler = ownProfiler = new OffCpuProfiler();
+
+    offCpuDone = new Semaphore("offCpuDone", 0);
+    offCpuLock = new Lock("offCpuLock");
+    offCpuGo = new Semaphore("offCpuGo", 0);
+    for (int i = 0; i < 3; i++) {
+        t = new Thread("offCpuLockWorker");
+        t->Fork(offCpuLockWorker, i);
+        t = new Thread("offCpuSemaphoreWorker");
+        t->Fork(offCpuSemaphoreWorker, i);
+    }
+    t = new Thread("offCpuJoinee", 1);
+    t->Fork(offCpuJoinee, 0);
+    t->Join();
+
+    for (int i = 0; i < 3; i++)
+        offCpuGo->V();
+    for (int i = 0; i < 6; i++)
+        offCpuDone->P();
+
+    printf("%d call chains blocked.\n", offCpuProfiler->NumStacks());
+    if (ownProfiler != NULL) {
+        ownProfiler->Print(NULL);
+        offCpuProfiler = NULL;
+        delete ownProfiler;
+    }
+    delete offCpuGo;
+    delete offCpuLock;
+    delete offCpuDone;
+}
+
+//----------------------------------------------------------------------
+// testChannel
+// Three senders each send 200 numbers through a Channel of 4 slots,
+// one at a time or in batches of 7, to three receivers that take
+// them one at a time or up to 5 at a time.  Every number must arrive
+// exactly once, and each receiver must see each sender's numbers in
+// the order they were sent.  Then
+// checks that TrySend and TryReceive don't wait.
+//----------------------------------------------------------------------
+
+#define ChannelThreads	3
+#define ChannelMessages	200
+
+static Semaphore *channelDone = NULL;
+Channel *channel = NULL;
+int channelSeen[ChannelThreads * ChannelMessages];
+int channelLast[ChannelThreads][ChannelThreads];  // [receiver][sender]
+bool channelInOrder = TRUE;
+
+void channelSender(int which) {
+    int batch[7];
+    int i = 0, n;
+
+    while (i < ChannelMessages) {
+        if (which % 2 == 0) {
+            channel->Send(which * ChannelMessages + i++);
+        } else {
+            for (n = 0; n < 7 && i < ChannelMessages; n++)
+                batch[n] = which * ChannelMessages + i++;
+            channel->SendN(batch, n);
+        }
+        if (Random() % 3 == 0)
+            currentThread->Yield();
+    }
+    channelDone->V();
+}
+
+void channelNote(int receiver, int message) {
+    int sender = message / ChannelMessages;
+
+    channelSeen[message]++;
+    if (message <= channelLast[receiver][sender])
+        channelInOrder = FALSE;
+    channelLast[receiver][sender] = message;
+}
+
+void channelReceiver(int which) {
+    int batch[5];
+    int received = 0;
+
+    while (received < ChannelMessages) {
+        if (which % 2 == 0) {
+            channel->Receive(batch);
+            channelNote(which, batch[0]);
+            received++;
+        } else {
+            int want = ChannelMessages - received;
+            int n = channel->ReceiveN(batch, (want < 5) ? want : 5);
+            for (int i = 0; i < n; i++)
+                channelNote(which, batch[i]);
+            received += n;
+        }
+    }
+    channelDone->V();
+}
+
+void testChannel() {
+    Thread *t;
+    int once = 0;
+    int message;
+
+    channelDone = new Semaphore("channelDone", 0);
+    channel = new Channel("channel", 4);
+    for (int i = 0; i < ChannelThreads; i++) {
+        for (int j = 0; j < ChannelThreads; j++)
+            channelLast[i][j] = -1;
+        t = new Thread("channelReceiver");
+        t->setPriority(i % 2);
+        t->Fork(channelReceiver, i);
+        t = new Thread("channelSender");
+        t->Fork(channelSender, i);
+    }
+    for (int i = 0; i < 2 * ChannelThreads; i++)
+        channelDone->P();
+
+    for (int i = 0; i < ChannelThreads * ChannelMessages; i++)
+        if (channelSeen[i] == 1)
+            once++;
+    printf("%d messages received once each (success if %d), "
+           "in order: %s.\n", once, ChannelThreads * ChannelMessages,
+           channelInOrder ? "yes" : "no");
+
+    for (int i = 0; i < 4; i++)
+        (void) channel->TrySend(i);
+    printf("TrySend on a full channel: %s (success if FALSE).\n",
+           channel->TrySend(4) ? "TRUE" : "FALSE");
+    while (channel->TryReceive(&message))
+        ;
+    printf("TryReceive on an empty channel: %s, last message %d "
+           "(success if FALSE, 3).\n",
+           channel->TryReceive(&message) ? "TRUE" : "FALSE", message);
+
+    delete channel;
+    delete channelDone;
+}
+
+//----------------------------------------------------------------------
+// benchChannel
+// Messages per second from one sender to one receiver: through a
+// Mailbox, which meets every Send with a Receive, and through Channels
+// of 1 to 256 slots, one message at a time and in batches of 64.
+//----------------------------------------------------------------------
+
+#define ChannelBenchMessages	100000
+#define ChannelBatch		64
+
+static Semaphore *channelBenchDone = NULL;
+Mailbox *benchMailbox = NULL;
+int channelBenchCount;
+
+void channelBenchSender(int mode) {
+    int batch[ChannelBatch];
+
+    for (int i = 0; i < channelBenchCount; ) {
+        if (mode == 0) {
+            benchMailbox->Send(i++);
+        } else if (mode == 1) {
+            channel->Send(i++);
+        } else {
+            int n;
+            for (n = 0; n < ChannelBatch && i < channelBenchCount; n++)
+                batch[n] = i++;
+            channel->SendN(batch, n);
+        }
+    }
+    channelBenchDone->V();
+}
+
+void channelBenchReceiver(int mode) {
+    int batch[ChannelBatch];
+
+    for (int i = 0; i < channelBenchCount; ) {
+        if (mode == 0) {
+            benchMailbox->Receive(batch);
+            i++;
+        } else if (mode == 1) {
+            channel->Receive(batch);
+            i++;
+        } else {
+            i += channel->ReceiveN(batch, ChannelBatch);
+        }
+    }
+    channelBenchDone->V();
+}
+
+void channelBenchRun(int mode, int capacity) {
+    static char *modes[] = { "Mailbox", "Channel", "Channel, batched" };
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    Thread *t;
+
+    t = new Thread("channelBenchReceiver");
+    t->Fork(channelBenchReceiver, mode);
+    t = new Thread("channelBenchSender");
+    t->Fork(channelBenchSender, mode);
+    channelBenchDone->P();
+    channelBenchDone->P();
+    secs = HostSeconds() - start;
+
+    printf("  %-17s %4d slots: %9.0f messages/sec, %5d ticks/message\n",
+           modes[mode], capacity, channelBenchCount / secs,
+           (stats->totalTicks - startTicks) / channelBenchCount);
+}
+
+void benchChannel() {
+    static int capacities[] = { 1, 16, 256 };
+
+    channelBenchDone = new Semaphore("channelBenchDone", 0);
+    channelBenchCount = ChannelBenchMessages / 10;  // Mailbox is slow
+    benchMailbox = new Mailbox();
+    channelBenchRun(0, 0);
+    delete benchMailbox;
+
+    channelBenchCount = ChannelBenchMessages;
+    for (int i = 0; i < (int)(sizeof(capacities) / sizeof(int)); i++) {
+        channel = new Channel("benchChannel", capacities[i]);
+        channelBenchRun(1, capacities[i]);
+        channelBenchRun(2, capacities[i]);
+        delete channel;
+    }
+    delete channelBenchDone;
+}
+
+//----------------------------------------------------------------------
+// testMessageBuffers
+// Three producers fill 4K buffers from a pool of 2 and send them
+// through one Mailbox to two consumers, which check that they now own
+// each buffer, that its data is where the producer wrote it (no copy),
+// and that the contents arrived intact, then free it for reuse.  Then
+// the pool runs dry, so that Allocate has to wait for a Free.
+//----------------------------------------------------------------------
+
+#define PoolBuffers	2
+#define PoolBufferSize	4096
+#define PoolMessages	50
+#define PoolProducers	3
+#define PoolConsumers	2
+
+static Semaphore *poolDone = NULL;
+BufferPool *bufferPool = NULL;
+char *poolSent[PoolMessages];	// where each message's data was
+int poolGood = 0;
+Semaphore *poolHogHas = NULL;
+bool poolHogFreed = FALSE;
+
+void poolProducer(int which) {
+    MessageBuffer *buffer;
+
+    for (int seq = which; seq < PoolMessages; seq += PoolProducers) {
+        buffer = bufferPool->Allocate();
+        char *data = buffer->getData();
+        data[0] = seq;
+        for (int j = 1; j < PoolBufferSize; j++)
+            data[j] = (char) (seq + j);
+        buffer->setLength(PoolBufferSize);
+        poolSent[seq] = data;
+        mBox->Send(buffer);
+        ASSERT(buffer->getOwner() != currentThread);
+    }
+    poolDone->V();
+}
+
+void poolConsumer(int which) {
+    MessageBuffer *buffer;
+    bool intact;
+
+    for (int i = which; i < PoolMessages; i += PoolConsumers) {
+        mBox->Receive(&buffer);
+        ASSERT(buffer->getOwner() == currentThread);
+        char *data = buffer->getData();
+        int seq = (unsigned char) data[0];
+
+        intact = (data == poolSent[seq]
+                  && buffer->getLength() == PoolBufferSize);
+        for (int j = 1; intact && j < PoolBufferSize; j++)
+            intact = (data[j] == (char) (seq + j));
+        if (intact)
+            poolGood++;
+        bufferPool->Free(buffer);
+    }
+    poolDone->V();
+}
+
+void poolHog(int which) {
+    MessageBuffer *buffer = bufferPool->Allocate();
+
+    poolHogHas->V();
+    for (int i = 0; i < 10; i++)
+        currentThread->Yield();		// main waits for a buffer
+    poolHogFreed = TRUE;
+    bufferPool->Free(buffer);
+    poolDone->V();
+}
+
+void testMessageBuffers() {
+    MessageBuffer *buffers[PoolBuffers];
+    Thread *t;
+
+    poolDone = new Semaphore("poolDone", 0);
+    mBox = new Mailbox();
+    bufferPool = new BufferPool("bufferPool", PoolBuffers, PoolBufferSize);
+    for (int i = 0; i < PoolProducers; i++) {
+        t = new Thread("poolProducer");
+        t->Fork(poolProducer, i);
+    }
+    for (int i = 0; i < PoolConsumers; i++) {
+        t = new Thread("poolConsumer");
+        t->Fork(poolConsumer, i);
+    }
+    for (int i = 0; i < PoolProducers + PoolConsumers; i++)
+        poolDone->P();
+    printf("%d buffers arrived intact and uncopied (success if %d); "
+           "%d free (success if %d).\n", poolGood, PoolMessages,
+           bufferPool->NumFree(), PoolBuffers);
+
+    // Take all but one buffer; the hog takes the last, and main has to
+    // wait until the hog frees it.
+    poolHogHas = new Semaphore("poolHogHas", 0);
+    for (int i = 0; i < PoolBuffers - 1; i++)
+        buffers[i] = bufferPool->Allocate();
+    t = new Thread("poolHog");
+    t->Fork(poolHog, 0);
+    poolHogHas->P();
+    buffers[PoolBuffers - 1] = bufferPool->Allocate();
+    printf("Allocate waited for a Free: %s; TryAllocate on an empty pool: "
+           "%s (success if yes, NULL).\n", poolHogFreed ? "yes" : "no",
+           bufferPool->TryAllocate() == NULL ? "NULL" : "a buffer");
+    for (int i = 0; i < PoolBuffers; i++)
+        bufferPool->Free(buffers[i]);
+    poolDone->P();
+
+    delete poolHogHas;
+    delete bufferPool;
+    delete mBox;
+    delete poolDone;
+}
+
+//----------------------------------------------------------------------
+// testSelect
+// One dispatcher thread serves a Mailbox, a Channel and a SynchList,
+// each fed by its own producer, by selecting on all three.  It must
+// get every message from each, then time out once they are all idle.
+//----------------------------------------------------------------------
+
+#define SelectMessages	20
+
+static Semaphore *selectDone = NULL;
+SynchList *selectList = NULL;
+int selectGot[3];
+
+void selectProducer(int which) {
+    for (int i = 0; i < SelectMessages; i++) {
+        if (which == 0)
+            mBox->Send(i);
+        else if (which == 1)
+            channel->Send(i);
+        else
+            selectList->Append((void *) (i + 1));
+        if (Random() % 2 == 0)
+            currentThread->Yield();
+    }
+}
+
+void selectDispatcher(int which) {
+    Select *select = new Select("select");
+    int message, received = 0, wakeups = 0;
+
+    ASSERT(select->Add(mBox) == 0);
+    ASSERT(select->Add(channel) == 1);
+    ASSERT(select->Add(selectList) == 2);
+    while (received < 3 * SelectMessages) {
+        wakeups++;
+        switch (select->Wait()) {
+        case 0:
+            mBox->Receive(&message);
+            selectGot[0]++;
+            received++;
+            break;
+        case 1:
+            while (channel->TryReceive(&message)) {
+                selectGot[1]++;
+                received++;
+            }
+            break;
+        case 2:
+            if (selectList->TryRemove() != NULL) {
+                selectGot[2]++;
+                received++;
+            }
+            break;
+        }
+    }
+    printf("Received %d, %d, %d (success if %d each), in %d selects.\n",
+           selectGot[0], selectGot[1], selectGot[2], SelectMessages,
+           wakeups);
+    printf("Select with nothing ready: %d (success if -1).\n",
+           select->Wait(1000));
+    delete select;
+    selectDone->V();
+}
+
+void testSelect() {
+    Thread *t;
+
+    selectDone = new Semaphore("selectDone", 0);
+    mBox = new Mailbox();
+    channel = new Channel("selectChannel", 4);
+    selectList = new SynchList();
+    t = new Thread("selectDispatcher");
+    t->Fork(selectDispatcher, 0);
+    for (int i = 0; i < 3; i++) {
+        t = new Thread("selectProducer");
+        t->Fork(selectProducer, i);
+    }
+    selectDone->P();
+    delete selectList;
+    delete channel;
+    delete mBox;
+    delete selectDone;
+}
+
+//----------------------------------------------------------------------
+// testRendezvous
+// Trades of two buyers and one seller: 6 buyers and 3 sellers arrive
+// 5 times each, and swap ids with the rest of their group.  There must
+// be 15 trades, every member of a trade must see the same 3 ids, and
+// those must be 2 buyers and a seller, including the member itself.
+//----------------------------------------------------------------------
+
+#define Trades		15
+
+static Semaphore *rendezvousDone = NULL;
+Rendezvous *rendezvous = NULL;
+int tradeIds[Trades][3];
+int tradeSeen[Trades];
+bool tradesGood = TRUE;
+
+void trader(int id) {
+    int role = (id < 100) ? 0 : 1;		// buyers are 0..99
+    int values[3];
+
+    for (int i = 0; i < 5; i++) {
+        int match = rendezvous->Arrive(role, id, values);
+
+        ASSERT(match >= 0 && match < Trades);
+        if (tradeSeen[match]++ == 0)
+            for (int j = 0; j < 3; j++)
+                tradeIds[match][j] = values[j];
+        for (int j = 0; j < 3; j++)
+            if (values[j] != tradeIds[match][j])
+                tradesGood = FALSE;
+        if (values[0] >= 100 || values[1] >= 100 || values[2] < 100
+                || (values[role == 0 ? 0 : 2] != id && values[1] != id))
+            tradesGood = FALSE;
+        if (Random() % 2 == 0)
+            currentThread->Yield();
+    }
+    rendezvousDone->V();
+}
+
+void testRendezvous() {
+    static int arity[] = { 2, 1 };
+    Thread *t;
+    int complete = 0;
+
+    rendezvousDone = new Semaphore("rendezvousDone", 0);
+    rendezvous = new Rendezvous("trades", 2, arity);
+    for (int i = 0; i < 9; i++) {
+        t = new Thread("trader");
+        t->setPriority(i % 3);
+        t->Fork(trader, (i < 6) ? i : 100 + i);
+    }
+    for (int i = 0; i < 9; i++)
+        rendezvousDone->P();
+
+    for (int i = 0; i < Trades; i++)
+        if (tradeSeen[i] == 3)
+            complete++;
+    printf("%d trades of 3 (success if %d), consistent: %s.\n",
+           complete, rendezvous->getMatches(), tradesGood ? "yes" : "no");
+    delete rendezvous;
+    delete rendezvousDone;
+}
+
+//----------------------------------------------------------------------
+// benchRendezvous
+// Matches per second of male, female and matchmaker threads through a
+// Whale, and through a Rendezvous with three roles, with 1 and 10
+// threads of each kind.  Each run makes 30000 matches.  Whale prints
+// a line for most matches, and its rate includes that printing.
+//----------------------------------------------------------------------
+
+#define RendezvousMatches	30000
+
+static Semaphore *rendezvousBenchDone = NULL;
+Whale *benchWhale = NULL;
+int rendezvousBenchRounds;
+
+void rendezvousBenchWorker(int which) {
+    int role = which % 3;
+
+    for (int i = 0; i < rendezvousBenchRounds; i++) {
+        if (benchWhale == NULL)
+            (void) rendezvous->Arrive(role);
+        else if (role == 0)
+            benchWhale->Male();
+        else if (role == 1)
+            benchWhale->Female();
+        else
+            benchWhale->Matchmaker();
+    }
+    rendezvousBenchDone->V();
+}
+
+void rendezvousBenchRun(bool useWhale, int perRole) {
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    Thread *t;
+
+    benchWhale = useWhale ? new Whale("benchWhale") : NULL;
+    rendezvous = new Rendezvous("benchRendezvous", 3);
+    rendezvousBenchRounds = RendezvousMatches / perRole;
+    for (int i = 0; i < 3 * perRole; i++) {
+        t = new Thread("rendezvousBenchWorker");
+        t->Fork(rendezvousBenchWorker, i);
+    }
+    for (int i = 0; i < 3 * perRole; i++)
+        rendezvousBenchDone->P();
+    secs = HostSeconds() - start;
+
+    printf("  %2d of each, %-10s: %9.0f matches/sec, %5d ticks/match\n",
+           perRole, useWhale ? "Whale" : "Rendezvous",
+           RendezvousMatches / secs,
+           (stats->totalTicks - startTicks) / RendezvousMatches);
+    delete rendezvous;
+    delete benchWhale;
+}
+
+void benchRendezvous() {
+    rendezvousBenchDone = new Semaphore("rendezvousBenchDone", 0);
+    rendezvousBenchRun(TRUE, 1);
+    rendezvousBenchRun(FALSE, 1);
+    rendezvousBenchRun(TRUE, 10);
+    rendezvousBenchRun(FALSE, 10);
+    delete rendezvousBenchDone;
+}
+
+//----------------------------------------------------------------------
+// testSynchListBatches
+// Moves 1000 items from 2 producers to 2 consumers through a SynchList
+// holding at most 8: first one at a time, with Append and Remove, then
+// in batches, with AppendN of 16 and RemoveUpTo 10.  Every item must
+// arrive once either way; the lock profiler counts how many times the
+// list's lock was taken for each.  Then checks that Append waits on a
+// full list and that RemoveUpTo times out on an empty one.  Last, an
+// Append comes after a RemoveUpTo has timed out but before it runs
+// again; a Remove that waits after that must still be woken.
+//----------------------------------------------------------------------
+
+#define PipelineItems	1000
+#define PipelineBatch	16
+
+static Semaphore *pipelineDone = NULL;
+SynchList *pipeline = NULL;
+bool pipelineBatched;
+int pipelineSeen[PipelineItems + 1];
+int pipelineConsumed;
+
+void pipelineProducer(int which) {
+    void *batch[PipelineBatch];
+    int n = 0;
+
+    for (int i = which + 1; i <= PipelineItems; i += 2) {
+        if (!pipelineBatched) {
+            pipeline->Append((void *) i);
+            continue;
+        }
+        batch[n++] = (void *) i;
+        if (n == PipelineBatch || i + 2 > PipelineItems) {
+            pipeline->AppendN(batch, n);
+            n = 0;
+        }
+    }
+    pipelineDone->V();
+}
+
+void pipelineConsumer(int which) {
+    void *batch[10];
+    int n;
+
+    while (pipelineConsumed < PipelineItems) {
+        n = pipeline->RemoveUpTo(batch, pipelineBatched ? 10 : 1, 1000);
+        for (int i = 0; i < n; i++)
+            pipelineSeen[(int) batch[i]]++;
+        pipelineConsumed += n;
+    }
+    pipelineDone->V();
+}
+
+void pipelineRun(bool batched) {
+    LockStats *listLock = lockProfiler->Lookup("list lock", FALSE);
+    int before = listLock->operations;
+    int once = 0;
+    Thread *t;
+
+    pipelineBatched = batched;
+    pipelineConsumed = 0;
+    for (int i = 1; i <= PipelineItems; i++)
+        pipelineSeen[i] = 0;
+    pipeline = new SynchList(8);
+    for (int i = 0; i < 2; i++) {
+        t = new Thread("pipelineProducer");
+        t->Fork(pipelineProducer, i);
+        t = new Thread("pipelineConsumer");
+        t->Fork(pipelineConsumer, i);
+    }
+    for (int i = 0; i < 4; i++)
+        pipelineDone->P();
+    delete pipeline;
+
+    for (int i = 1; i <= PipelineItems; i++)
+        if (pipelineSeen[i] == 1)
+            once++;
+    printf("%-8s: %d items arrived once (success if %d), "
+           "%d lock acquisitions.\n", batched ? "batched" : "one each",
+           once, PipelineItems, listLock->operations - before);
+}
+
+void pipelineBlockedAppend(int which) {
+    pipeline->Append((void *) 3);	// waits: the list is full
+    pipelineConsumed = 1;
+    pipelineDone->V();
+}
+
+void pipelineExpiring(int which) {
+    void *item;
+
+    pipelineConsumed = pipeline->RemoveUpTo(&item, 1, 100);
+    pipelineDone->V();
+}
+
+void pipelineLateRemove(int which) {
+    (void) pipeline->Remove();
+    pipelineConsumed++;
+    pipelineDone->V();
+}
+
+void testSynchListBatches() {
+    LockProfiler *ownProfiler = NULL;
+    void *items[2];
+    Thread *t;
+    int start, n;
+
+    if (lockProfiler == NULL)
+        lockProfiler = ownProfiler = new LockProfiler();
+    pipelineDone = new Semaphore("pipelineDone", 0);
+
+    pipelineRun(FALSE);
+    pipelineRun(TRUE);
+
+    pipeline = new SynchList(2);
+    pipeline->Append((void *) 1);
+    pipeline->Append((void *) 2);
+    pipelineConsumed = 0;
+    t = new Thread("pipelineBlockedAppend");
+    t->Fork(pipelineBlockedAppend, 0);
+    for (int i = 0; i < 10; i++)
+        currentThread->Yield();
+    printf("Append to a full list waited: %s (success if yes).\n",
+           pipelineConsumed == 0 ? "yes" : "no");
+    n = pipeline->RemoveUpTo(items, 2, 0);
+    pipelineDone->P();
+    n += pipeline->RemoveUpTo(items, 2, 0);
+    start = stats->totalTicks;
+    n += pipeline->RemoveUpTo(items, 2, 500);
+    printf("Removed %d items (success if 3); waiting on an empty list "
+           "took %s 500 ticks (success if at least).\n", n,
+           stats->totalTicks - start >= 500 ? "at least" : "under");
+    delete pipeline;
+
+    // Let the RemoveUpTo time out without giving up the CPU, so that
+    // it is still to run when we Append.
+    pipeline = new SynchList();
+    t = new Thread("pipelineExpiring");
+    t->Fork(pipelineExpiring, 0);
+    currentThread->Yield();
+    start = stats->totalTicks;
+    while (stats->totalTicks < start + 200) {
+        (void) interrupt->SetLevel(IntOff);
+        (void) interrupt->SetLevel(IntOn);	// a tick goes by
+    }
+    pipeline->Append((void *) 4);
+    t = new Thread("pipelineLateRemove");
+    t->Fork(pipelineLateRemove, 0);
+    currentThread->Yield();
+    pipeline->Append((void *) 5);
+    pipelineDone->P();
+    pipelineDone->P();
+    printf("After an Append raced a timeout, %d items were removed "
+           "(success if 2).\n", pipelineConsumed);
+    delete pipeline;
+
+    delete pipelineDone;
+    if (ownProfiler != NULL) {
+        lockProfiler = NULL;
+        delete ownProfiler;
+    }
+}
+
+//----------------------------------------------------------------------
+// testThreadPool
+// Runs 1000 short procedures, first with a thread forked for each,
+// then through a fixed pool of 4 workers, and compares the cost.  Then
+// checks the results of work submitted with handles, and that an
+// elastic pool grows to meet a burst of work and shrinks back to its
+// minimum once its extra workers have been idle for a while.  Last,
+// work is queued after a lone worker's idle wait has run out but
+// before it runs again; the work after that must not have to wait for
+// the worker's next timeout.
+//----------------------------------------------------------------------
+
+#define PoolTasks	1000
+
+static Semaphore *threadPoolDone = NULL;
+int poolResults[PoolTasks];
+
+void poolSquare(int i) {
+    poolResults[i] = i * i;
+    threadPoolDone->V();
+}
+
+void poolSlowSquare(int i) {
+    for (int j = 0; j < 5; j++)
+        currentThread->Yield();
+    poolResults[i] = i * i;
+}
+
+void poolRun(bool pooled) {
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    ThreadPool *pool = NULL;
+    Thread *t;
+
+    if (pooled)
+        pool = new ThreadPool("benchPool", 4);
+    for (int i = 0; i < PoolTasks; i++) {
+        if (pooled) {
+            pool->Execute(poolSquare, i);
+        } else {
+            t = new Thread("poolSquare");
+            t->Fork(poolSquare, i);
+        }
+    }
+    for (int i = 0; i < PoolTasks; i++)
+        threadPoolDone->P();
+    secs = HostSeconds() - start;
+
+    printf("  %-16s: %9.0f tasks/sec, %5d ticks/task, %d threads\n",
+           pooled ? "pool of 4" : "fork per task", PoolTasks / secs,
+           (stats->totalTicks - startTicks) / PoolTasks,
+           pooled ? pool->getWorkersStarted() : PoolTasks);
+    delete pool;
+}
+
+void testThreadPool() {
+    PoolTask *handles[16];
+    ThreadPool *pool;
+    Semaphore *never;
+    int right = 0, grown, start;
+
+    threadPoolDone = new Semaphore("threadPoolDone", 0);
+    poolRun(FALSE);
+    poolRun(TRUE);
+
+    pool = new ThreadPool("elasticPool", 1, 8, 1000);
+    for (int i = 0; i < 16; i++) {
+        poolResults[i] = 0;
+        handles[i] = pool->Submit(poolSlowSquare, i);
+    }
+    for (int i = 0; i < 16; i++) {
+        handles[i]->Join();
+        if (poolResults[i] == i * i)
+            right++;
+    }
+    grown = pool->getWorkersStarted();
+    printf("Joined %d right results (success if 16); the pool grew "
+           "past 1 worker: %s (success if yes).\n", right,
+           grown > 1 ? "yes" : "no");
+
+    never = new Semaphore("never", 0);
+    (void) never->P(5000);		// let the extra workers time out
+    delete never;
+    printf("After 5000 idle ticks: %d workers (success if 1).\n",
+           pool->NumWorkers());
+    delete pool;
+
+    pool = new ThreadPool("onePool", 0, 1, 1000);
+    pool->Submit(poolSlowSquare, 0)->Join();
+    start = stats->totalTicks;
+    while (stats->totalTicks < start + 1100) {
+        (void) interrupt->SetLevel(IntOff);
+        (void) interrupt->SetLevel(IntOn);	// a tick goes by
+    }
+    pool->Submit(poolSlowSquare, 1)->Join();
+    start = stats->totalTicks;
+    pool->Submit(poolSlowSquare, 2)->Join();
+    printf("Work queued after a worker timed out, then more work: the "
+           "second took %s 1000 ticks (success if under).\n",
+           stats->totalTicks - start < 1000 ? "under" : "at least");
+    delete pool;
+
+    delete threadPoolDone;
+}
+
+//----------------------------------------------------------------------
+// testTaskRuntime
+// Computes Fibonacci numbers by naive recursion, with each recursive
+// call but the last made in parallel: first with a joinable thread
+// forked for each, then with a task spawned on a runtime of 4 workers,
+// and compares the cost.  Without -rs nothing is preempted, so the
+// spawned calls yield at the leaves to give the other workers a chance
+// to steal.  Each call gets its argument, and leaves its
+// result, in a cell on its caller's stack.
+//----------------------------------------------------------------------
+
+#define FibForked	14
+#define FibSpawned	20
+
+TaskRuntime *taskRuntime = NULL;
+int fibAnswer;
+
+int fibSerial(int n) {
+    return n < 2 ? n : fibSerial(n - 1) + fibSerial(n - 2);
+}
+
+void fibForked(int cell) {
+    int n = *(int *) cell;
+    int a = n - 1, b = n - 2;
+    Thread *t;
+
+    if (n < 2)
+        return;
+    t = new Thread("fibForked", 1);
+    t->Fork(fibForked, (int) &a);
+    fibForked((int) &b);
+    t->Join();
+    *(int *) cell = a + b;
+}
+
+void fibSpawned(int cell) {
+    int n = *(int *) cell;
+    int a = n - 1, b = n - 2;
+
+    if (n < 2) {
+        currentThread->Yield();		// let the other workers steal
+        return;
+    }
+    taskRuntime->Spawn(fibSpawned, (int) &a);
+    fibSpawned((int) &b);
+    taskRuntime->Sync();
+    *(int *) cell = a + b;
+}
+
+void testTaskRuntime() {
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    Thread *t = new Thread("fibForked", 1);
+
+    fibAnswer = FibForked;
+    t->Fork(fibForked, (int) &fibAnswer);
+    t->Join();
+    secs = HostSeconds() - start;
+    printf("  forked threads: fib(%d) = %d (success if %d), %d forks, "
+           "%9.0f forks/sec, %5d ticks/fork\n", FibForked, fibAnswer,
+           fibSerial(FibForked), fibSerial(FibForked + 1) - 1,
+           (fibSerial(FibForked + 1) - 1) / secs,
+           (stats->totalTicks - startTicks) / (fibSerial(FibForked + 1) - 1));
+
+    taskRuntime = new TaskRuntime("fibRuntime", 4);
+    startTicks = stats->totalTicks;
+    start = HostSeconds();
+    fibAnswer = FibSpawned;
+    taskRuntime->Run(fibSpawned, (int) &fibAnswer);
+    secs = HostSeconds() - start;
+    printf("  spawned tasks : fib(%d) = %d (success if %d), %d spawns, "
+           "%9.0f spawns/sec, %5d ticks/spawn\n", FibSpawned, fibAnswer,
+           fibSerial(FibSpawned), fibSerial(FibSpawned + 1) - 1,
+           (fibSerial(FibSpawned + 1) - 1) / secs,
+           (stats->totalTicks - startTicks) / (fibSerial(FibSpawned + 1) - 1));
+    printf("Spawned %d tasks (success if %d), of which some were stolen: "
+           "%s (success if yes).\n", taskRuntime->getSpawned(),
+           fibSerial(FibSpawned + 1), taskRuntime->getSteals() > 0 ?
+           "yes" : "no");
+    delete taskRuntime;
+    taskRuntime = NULL;
+}
+
+//----------------------------------------------------------------------
+// benchParallel
+// Runs ParallelFor over 65536 items on a runtime of 4 workers, at grain
+// sizes from 1 item to 4096 and the automatic one, to show how much of
+// the cost is splitting and spawning.  Then checks ParallelReduce,
+// ParallelScan and ParallelSort against the serial answers.
+//----------------------------------------------------------------------
+
+#define ParallelItems	65536
+
+class SquareBody {
+public:
+    int *items;
+
+    void Run(int first, int last) {
+        for (int i = first; i < last; i++)
+            items[i] = (i % 100) * (i % 100);
+    }
+};
+
+class SumBody {
+public:
+    int *items;
+
+    int Reduce(int first, int last, int sum) {
+        for (int i = first; i < last; i++)
+            sum += items[i];
+        return sum;
+    }
+    int Combine(int left, int right) {
+        return left + right;
+    }
+};
+
+void parallelForRun(TaskRuntime *runtime, int *items, int grain) {
+    SquareBody body;
+    int startTicks = stats->totalTicks;
+    int startSpawned = runtime->getSpawned();
+    double start = HostSeconds();
+    double secs;
+    char grainName[16];
+
+    body.items = items;
+    ParallelFor(runtime, 0, ParallelItems, grain, &body);
+    secs = HostSeconds() - start;
+    sprintf(grainName, grain > 0 ? "%d" : "auto (%d)",
+            ParallelGrain(runtime, ParallelItems, grain));
+    printf("  grain %-11s: %6d tasks, %9.0f items/sec, %7d ticks\n",
+           grainName, runtime->getSpawned() - startSpawned,
+           ParallelItems / secs, stats->totalTicks - startTicks);
+}
+
+void benchParallel() {
+    TaskRuntime *runtime = new TaskRuntime("parallel", 4);
+    int *items = new int[ParallelItems];
+    SumBody sum;
+    int expected = 0, ok = 0;
+
+    for (int grain = 1; grain <= 4096; grain *= 16)
+        parallelForRun(runtime, items, grain);
+    parallelForRun(runtime, items, 0);
+
+    for (int i = 0; i < ParallelItems; i++)
+        expected += (i % 100) * (i % 100);
+    sum.items = items;
+    printf("ParallelReduce: sum %s (success if right).\n",
+           ParallelReduce(runtime, 0, ParallelItems, 0, 0, &sum) == expected ?
+           "right" : "wrong");
+
+    for (int i = 0; i < ParallelItems; i++)
+        items[i] = 1;
+    ParallelScan(runtime, items, ParallelItems, 1000);
+    for (int i = 0; i < ParallelItems; i++)
+        if (items[i] == i + 1)
+            ok++;
+    printf("ParallelScan: %d prefix sums right (success if %d).\n", ok,
+           ParallelItems);
+
+    for (int i = 0; i < ParallelItems; i++)
+        items[i] = (i * 7919) % ParallelItems;	// a permutation
+    ParallelSort(runtime, items, ParallelItems, 0);
+    ok = 0;
+    for (int i = 0; i < ParallelItems; i++)
+        if (items[i] == i)
+            ok++;
+    printf("ParallelSort: %d items in place (success if %d).\n", ok,
+           ParallelItems);
+
+    delete [] items;
+    delete runtime;
+}
+
+//----------------------------------------------------------------------
+// testFutures
+// Forks 10 threads with ForkFuture, which wait for a go-ahead; checks
+// that TryGet doesn't wait for them, then lets them go and collects
+// their results with Get.  Then forks 200 more, each with a
+// continuation that adds up the results, and detaches them all, so
+// that only one thread waits, for the last of them.  Last, a thread
+// Gets a future that the main thread Sets, and a continuation
+// registered after that is called at once.
+//----------------------------------------------------------------------
+
+#define FuturesDetached	200
+
+static Semaphore *futuresDone = NULL;
+int futuresSum;
+int futuresLeft;
+int futuresCalledAt;
+
+Semaphore *futuresGate;
+
+int futureSquare(int n) {
+    currentThread->Yield();
+    return n * n;
+}
+
+int futureGatedSquare(int n) {
+    futuresGate->P();
+    return n * n;
+}
+
+void futureAdd(int result, int arg) {
+    futuresSum += result;
+    if (--futuresLeft == 0)
+        futuresDone->V();
+}
+
+void futureNote(int result, int arg) {
+    futuresCalledAt = arg;
+}
+
+void futureGetter(int future) {
+    printf("Got %d from the promise (success if 42).\n",
+           ((Future<int> *) future)->Get());
+    futuresDone->V();
+}
+
+void testFutures() {
+    Future<int> *futures[10];
+    Future<int> *promise;
+    int right = 0, early = 0, result, expected = 0;
+    Thread *t;
+
+    futuresDone = new Semaphore("futuresDone", 0);
+    futuresGate = new Semaphore("futuresGate", 0);
+    for (int i = 0; i < 10; i++)
+        futures[i] = ForkFuture(new Thread("futureGatedSquare"),
+                                futureGatedSquare, i);
+    for (int i = 0; i < 10; i++)
+        if (futures[i]->TryGet(&result))
+            early++;
+    for (int i = 0; i < 10; i++)
+        futuresGate->V();
+    for (int i = 0; i < 10; i++) {
+        if (futures[i]->Get() == i * i && futures[i]->TryGet(&result))
+            right++;
+        delete futures[i];
+    }
+    delete futuresGate;
+    printf("TryGet found %d done early (success if 0); Get returned %d "
+           "right (success if 10).\n", early, right);
+
+    futuresSum = 0;
+    futuresLeft = FuturesDetached;
+    for (int i = 0; i < FuturesDetached; i++) {
+        Future<int> *future = ForkFuture(new Thread("futureSquare"),
+                                         futureSquare, i);
+        future->Then(futureAdd, 0);
+        future->Detach();
+        expected += i * i;
+    }
+    futuresDone->P();
+    printf("Continuations added up %d (success if %d).\n", futuresSum,
+           expected);
+
+    promise = new Future<int>("promise");
+    t = new Thread("futureGetter");
+    t->Fork(futureGetter, (int) promise);
+    currentThread->Yield();
+    promise->Set(42);
+    futuresDone->P();
+    futuresCalledAt = 0;
+    promise->Then(futureNote, 1);
+    printf("A late continuation was called %s (success if at once).\n",
+           futuresCalledAt == 1 ? "at once" : "later");
+    delete promise;
+
+    delete futuresDone;
+}
+
+//----------------------------------------------------------------------
+// testWaitGroup
+// Forks 1000 children and waits for them all: first joinable ones,
+// joined one at a time, then ones forked into a WaitGroup, and compares
+// the cost.  Then forks 5 children that each wait for the go-ahead,
+// lets them go in a shuffled order, and checks that JoinAny returns
+// them in that order.
+//----------------------------------------------------------------------
+
+#define GroupChildren	1000
+
+Semaphore *groupGo[5];
+int groupRan;
+
+void groupChild(int which) {
+    groupRan++;
+}
+
+void groupWaiter(int which) {
+    groupGo[which]->P();
+}
+
+void groupRun(bool grouped) {
+    Thread **children = new Thread *[GroupChildren];
+    WaitGroup *group = new WaitGroup("children");
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+
+    groupRan = 0;
+    for (int i = 0; i < GroupChildren; i++) {
+        if (grouped) {
+            children[i] = new Thread("groupChild");
+            children[i]->Fork(groupChild, i, group);
+        } else {
+            children[i] = new Thread("groupChild", 1);
+            children[i]->Fork(groupChild, i);
+        }
+    }
+    if (grouped)
+        group->Wait();
+    else
+        for (int i = 0; i < GroupChildren; i++)
+            children[i]->Join();
+    secs = HostSeconds() - start;
+
+    printf("  %-20s: %d ran (success if %d), %9.0f children/sec, "
+           "%4d ticks/child\n", grouped ? "WaitGroup" : "Join one at a time",
+           groupRan, GroupChildren, GroupChildren / secs,
+           (stats->totalTicks - startTicks) / GroupChildren);
+    delete group;
+    delete [] children;
+}
+
+void testWaitGroup() {
+    static int order[5] = { 3, 1, 4, 0, 2 };
+    WaitGroup *group = new WaitGroup("joinAny");
+    Thread *t;
+    int right = 0;
+
+    groupRun(FALSE);
+    groupRun(TRUE);
+
+    for (int i = 0; i < 5; i++) {
+        groupGo[i] = new Semaphore("groupGo", 0);
+        t = new Thread("groupWaiter");
+        t->Fork(groupWaiter, i, group);
+    }
+    for (int i = 0; i < 5; i++) {
+        groupGo[order[i]]->V();
+        if (group->JoinAny() == order[i])
+            right++;
+    }
+    printf("JoinAny returned %d children in the order they finished "
+           "(success if 5); %d outstanding (success if 0).\n", right,
+           group->NumOutstanding());
+    for (int i = 0; i < 5; i++)
+        delete groupGo[i];
+    delete group;
+}
+
+//----------------------------------------------------------------------
+// testZombies
+// Forks 200 joinable children and lets them all finish before joining
+// any: each should be a zombie by then, its stack already freed, and
+// Join should not block on it.  Then checks that a parent joining a
+// child that hasn't finished waits for it.
+//----------------------------------------------------------------------
+
+#define ZombieChildren	200
+
+int zombiesRan;
+
+void zombieChild(int which) {
+    zombiesRan++;
+}
+
+void zombieSlowChild(int which) {
+    for (int i = 0; i < 10; i++)
+        currentThread->Yield();
+    zombiesRan++;
+}
+
+void testZombies() {
+    Thread **children = new Thread *[ZombieChildren];
+    int zombies = 0;
+    int startTicks;
+
+    zombiesRan = 0;
+    for (int i = 0; i < ZombieChildren; i++) {
+        children[i] = new Thread("zombieChild", 1);
+        children[i]->Fork(zombieChild, i);
+    }
+    while (zombiesRan < ZombieChildren)
+        currentThread->Yield();
+    currentThread->Yield();		// the last one's stack goes now
+    for (int i = 0; i < ZombieChildren; i++)
+        if (children[i]->getStatus() == ZOMBIE)
+            zombies++;
+    startTicks = stats->totalTicks;
+    for (int i = 0; i < ZombieChildren; i++)
+        children[i]->Join();
+    printf("%d finished children were zombies, stacks freed, before Join "
+           "(success if %d); joining them took %d ticks.\n", zombies,
+           ZombieChildren, stats->totalTicks - startTicks);
+    delete [] children;
+
+    zombiesRan = 0;
+    children = new Thread *[1];
+    children[0] = new Thread("zombieSlowChild", 1);
+    children[0]->Fork(zombieSlowChild, 0);
+    children[0]->Join();
+    printf("Join waited for a running child: %s (success if yes).\n",
+           zombiesRan == 1 ? "yes" : "no");
+    delete [] children;
+}
+
+//----------------------------------------------------------------------
+// testReaper
+// Forks 1000 threads one after another, each of which finishes before
+// the next is forked: the dead should be reaped as the next needs a
+// stack, so a stack or two serves them all.  Then forks 100 at once, and
+// checks that no more than DeadLimit dead threads are ever kept, and
+// that they are all reaped once there is nothing else to do.
+//----------------------------------------------------------------------
+
+#define ReaperThreads	1000
+
+static Semaphore *reaperDone = NULL;
+int reaperMostDead;
+
+void reaperChild(int which) {
+    if (scheduler->NumDead() > reaperMostDead)
+        reaperMostDead = scheduler->NumDead();
+}
+
+void reaperCountedChild(int which) {
+    reaperChild(which);
+    reaperDone->V();
+}
+
+void testReaper() {
+    int allocated = stackPool->getAllocated();
+    int reused = stackPool->getReused();
+    int startTicks = stats->totalTicks;
+    double start = HostSeconds();
+    double secs;
+    Semaphore *never;
+    Thread *t;
+
+    for (int i = 0; i < ReaperThreads; i++) {
+        t = new Thread("reaperChild");
+        t->Fork(reaperChild, i);
+        currentThread->Yield();
+    }
+    secs = HostSeconds() - start;
+    printf("%d threads forked and finished: %9.0f threads/sec, "
+           "%d ticks/thread; %d stacks from the host (success if at most 4), "
+           "%d reused.\n", ReaperThreads, ReaperThreads / secs,
+           (stats->totalTicks - startTicks) / ReaperThreads,
+           stackPool->getAllocated() - allocated,
+           stackPool->getReused() - reused);
+
+    reaperMostDead = 0;
+    reaperDone = new Semaphore("reaperDone", 0);
+    for (int i = 0; i < 100; i++) {
+        t = new Thread("reaperCountedChild");
+        t->Fork(reaperCountedChild, i);
+    }
+    for (int i = 0; i < 100; i++)
+        reaperDone->P();
+    never = new Semaphore("never", 0);
+    (void) never->P(100);		// nothing else to do: idle
+    delete never;
+    delete reaperDone;
+    printf("At most %d dead threads kept (success if at most %d); %d "
+           "left after idling (success if 0).\n", reaperMostDead,
+           DeadLimit, scheduler->NumDead());
+}
+
+//----------------------------------------------------------------------
+// testMailboxSenders
+// Several senders and receivers share one Mailbox.  First a sender
+// that a receiver has just woken up is overtaken by a new sender, main,
+// which barges in while the woken one waits for the lock; then a second
+// receiver comes for the message the overtaken sender still has.  Then
+// 3 senders and 2 receivers pass 12 messages at random.  Every message
+// must arrive exactly once, and nobody may be left waiting.
+//----------------------------------------------------------------------
+
+#define MailboxSenders		3
+#define MailboxReceivers	2
+#define MailboxMessages		12
+
+static Semaphore *mailboxDone = NULL;
+static int mailboxSeen[MailboxMessages + 2];
+
+void mailboxSender(int which) {
+    for (int i = which; i < MailboxMessages; i += MailboxSenders)
+        mBox->Send(i);
+    mailboxDone->V();
+}
+
+void mailboxReceiver(int which) {
+    int message;
+
+    for (int i = which; i < MailboxMessages; i += MailboxReceivers) {
+        mBox->Receive(&message);
+        mailboxSeen[message]++;
+    }
+    mailboxDone->V();
+}
+
+void mailboxOneSend(int message) {
+    mBox->Send(message);
+    mailboxDone->V();
+}
+
+void mailboxOneReceive(int which) {
+    int message;
+
+    mBox->Receive(&message);
+    mailboxSeen[message]++;
+    mailboxDone->V();
+}
+
+void testMailboxSenders() {
+    int once = 0;
+    Thread *t;
+
+    mailboxDone = new Semaphore("mailboxDone", 0);
+    mBox = new Mailbox();
+    for (int i = 0; i < MailboxMessages + 2; i++)
+        mailboxSeen[i] = 0;
+
+    // The sender waits; the receiver wakes it and waits for the message;
+    // before the sender gets the lock back, main sends too.  The second
+    // receiver is forked first, since main may yet have to wait for it.
+    t = new Thread("mailboxOneSend");
+    t->Fork(mailboxOneSend, MailboxMessages);
+    currentThread->Yield();
+    t = new Thread("mailboxOneReceive");
+    t->Fork(mailboxOneReceive, 0);
+    currentThread->Yield();
+    t = new Thread("mailboxOneReceive");
+    t->Fork(mailboxOneReceive, 1);
+    mBox->Send(MailboxMessages + 1);
+    for (int i = 0; i < 3; i++)
+        mailboxDone->P();
+
+    for (int i = 0; i < MailboxSenders; i++) {
+        t = new Thread("mailboxSender");
+        t->Fork(mailboxSender, i);
+    }
+    for (int i = 0; i < MailboxReceivers; i++) {
+        t = new Thread("mailboxReceiver");
+        t->Fork(mailboxReceiver, i);
+    }
+    for (int i = 0; i < MailboxSenders + MailboxReceivers; i++)
+        mailboxDone->P();
+
+    for (int i = 0; i < MailboxMessages + 2; i++)
+        if (mailboxSeen[i] == 1)
+            once++;
+    printf("%d messages arrived once each (success if %d).\n", once,
+           MailboxMessages + 2);
+    delete mBox;
+    delete mailboxDone;
+    mBox = NULL;
+}
+
 //----------------------------------------------------------------------
 // ThreadTest
 
@@ -1195,19 +3478,38 @@ void NoForkJoin () {
 
 //----------------------------------------------------------------------
 // JointTest
-//  Join is not called more than once on a thread
+//  Join is not called more than once on a thread.  A joined thread is
+//  deleted as Join returns, so the second Join has to come while the
+//  first is still waiting: a helper joins the child, which is held up
+//  on a semaphore, then we try to join it too.
 //----------------------------------------------------------------------
 
+Thread *joinTwiceChild = NULL;
+Semaphore *joinTwiceGate = NULL;
+bool joinTwiceWaiting = false;
+
+void joinTwiceBlocked(int arg) {
+    joinTwiceGate->P();			// never V'd: we must not finish
+}
+
+void joinTwiceHelper(int arg) {
+    joinTwiceWaiting = true;
+    joinTwiceChild->Join();
+}
+
 void callJoinTwice() {
     printf("create a Join\n");
-    Thread *child = new Thread("callTWice\n", 1);
+    joinTwiceGate = new Semaphore("joinTwiceGate", 0);
+    joinTwiceChild = new Thread("callTWice\n", 1);
+    joinTwiceChild->Fork(joinTwiceBlocked, 0);
 
-    child->Fork((VoidFunctionPtr)printfSomeThing, 0);
-    
-    child->Join();
+    Thread *helper = new Thread("joinTwiceHelper");
+    helper->Fork(joinTwiceHelper, 0);
+    while (!joinTwiceWaiting)
+        currentThread->Yield();
     printf("called join first time\n");
 
-    child->Join();
+    joinTwiceChild->Join();
     printf("called join second time\n");
     printf("this statement should not be print because join cannot be called more then noce\n");
 
@@ -1302,6 +3604,64 @@ ThreadTest()
     case 35: 
     NoBlockingAfterChildFinish();
     break;
+    case 36:
+    testBoostWaiting(); break;
+    case 37:
+    benchUncontendedLock(); break;
+    case 38:
+    testAdaptiveLock(); break;
+    case 39:
+    testRWLock(); break;
+    case 40:
+    benchRWLock(); break;
+    case 41:
+    testHandoff(); break;
+    case 42:
+    testWaitMorphing(); break;
+    case 43:
+    testTimedWaits(); break;
+    case 44:
+    testTryOperations(); break;
+    case 45:
+    testBarrier(); break;
+    case 46:
+    benchBarrier(); break;
+    case 47:
+    testCompactLocks(); break;
+    case 48:
+    testLockProfiler(); break;
+    case 49:
+    testOffCpuProfiler(); break;
+    case 50:
+    testChannel(); break;
+    case 51:
+    benchChannel(); break;
+    case 52:
+    testMessageBuffers(); break;
+    case 53:
+    testSelect(); break;
+    case 54:
+    testRendezvous(); break;
+    case 55:
+    benchRendezvous(); break;
+    case 56:
+    testSynchListBatches(); break;
+    case 57:
+    testThreadPool(); break;
+    case 58:
+    testTaskRuntime(); break;
+    case 59:
+    benchParallel(); break;
+    case 60:
+    testFutures(); break;
+    case 61:
+    testWaitGroup(); break;
+    case 62:
+    testZombies(); break;
+    case 63:
+    testReaper(); break;
+    case 64:
+    testMailboxSenders(); break;
 
 
 
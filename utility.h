@@ -39,6 +39,12 @@
 #define divRoundDown(n,s)  ((n) / (s))
 #define divRoundUp(n,s)    (((n) / (s)) + ((((n) % (s)) > 0) ? 1 : 0))
 
+// Atomically: if *ptr equals old, set it to new and return TRUE,
+// otherwise leave it alone and return FALSE.  A single instruction
+// on the host, so it needs no interrupt masking -- and it would
+// still be atomic if Nachos threads ever ran on more than one CPU.
+#define CompareAndSwap(ptr,old,new)  __sync_bool_compare_and_swap(ptr, old, new)
+
 // This declares the type "VoidFunctionPtr" to be a "pointer to a
 // function taking an integer argument and returning nothing".  With
 // such a function pointer (say it is "func"), we can call it like this: